@@ -0,0 +1,357 @@
+// SCMTIFF Copyright (C) 2012-2015 Robert Kooima
+//
+// This program is free software: you can redistribute it and/or modify it
+// under the terms of the GNU General Public License as published by the Free
+// Software Foundation, either version 3 of the License, or (at your option)
+// any later version.
+//
+// This program is distributed in the hope that it will be useful, but WITH-
+// OUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+// FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License for
+// more details.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <sys/stat.h>
+
+#include "config.h"
+#include "scm.h"
+#include "scmdat.h"
+#include "util.h"
+#include "process.h"
+
+//------------------------------------------------------------------------------
+
+// Return the size of the named file in bytes.
+
+static long long filesize(const char *name)
+{
+    struct stat st;
+
+    if (stat(name, &st) == 0)
+        return (long long) st.st_size;
+    else
+        return 0;
+}
+
+// Pages read back at a time by the asynchronous read workers, one per worker.
+
+#define A 16
+
+// Copy all pages of s to the named file with r rows per strip and compression
+// Z, read them back, and report the compression ratio and the encode and decode
+// throughput. Pages are read back both in turn and A at a time asynchronously.
+
+static void process(scm *s, const char *out, int r, const int *Z, float *p)
+{
+    const int n = scm_get_n(s);
+    const int c = scm_get_c(s);
+    const int b = scm_get_b(s);
+    const int g = scm_get_g(s);
+
+    const long long l = scm_get_length(s);
+
+    long long k = 0;
+    double    e = 0;
+    double    d = 0;
+    double    w = 0;
+    double    t;
+
+    long long N[4] = { 0, 0, 0, 0 };
+    long long R[4] = { 0, 0, 0, 0 };
+    long long C[4] = { 0, 0, 0, 0 };
+
+    scm *u;
+
+    // Encode all pages. Decoding the source pages is not counted.
+
+    if ((u = scm_ofile_io(out, n, c, b, g, r, SCM_IO_PREAD)))
+    {
+        long long a = 0;
+
+        if (Z[0])
+            scm_set_compression(u, Z[0], Z[1]);
+
+        scm_set_constant(u, Z[2]);
+
+        for (long long i = 0; i < l; i++)
+        {
+            const long long o = scm_get_offset(s, i);
+            const long long x = scm_get_index (s, i);
+
+            if (o && scm_read_page(s, o, p))
+            {
+                t  = now();
+                a  = scm_append(u, a, x, p);
+                e += now() - t;
+                k += 1;
+            }
+        }
+        for (int o = 0; o < 4; o++)
+            scm_get_code_stats(u, o, N + o, R + o, C + o);
+
+        scm_close(u);
+    }
+
+    // Decode all pages.
+
+    if ((u = scm_ifile_io(out, SCM_IO_PREAD)))
+    {
+        if (scm_scan_catalog(u))
+        {
+            for (long long i = 0; i < scm_get_length(u); i++)
+            {
+                const long long o = scm_get_offset(u, i);
+
+                if (o)
+                {
+                    t  = now();
+                    scm_read_page(u, o, p);
+                    d += now() - t;
+                }
+            }
+
+            // Decode all pages again, keeping A reads in flight.
+
+            float *v[A];
+            int    j;
+
+            for (j = 0; j < A; j++)
+                v[j] = NULL;
+            for (j = 0; j < A; j++)
+                if ((v[j] = scm_alloc_buffer(u)) == NULL)
+                    break;
+
+            if (j == A && scm_read_threads(u, A))
+            {
+                t = now();
+
+                for (long long i = 0; i < scm_get_length(u); i += A)
+                {
+                    for (j = 0; j < A && i + j < scm_get_length(u); j++)
+                    {
+                        const long long o = scm_get_offset(u, i + j);
+
+                        if (o)
+                            scm_read_page_async(u, o, v[j], NULL, NULL);
+                    }
+                    scm_read_wait(u);
+                }
+                w = now() - t;
+
+                scm_read_threads(u, 0);
+            }
+            for (j = 0; j < A; j++)
+                free(v[j]);
+        }
+        scm_close(u);
+    }
+
+    // Report the results.
+
+    const double raw = (double) k * (double) (n + 2)
+                                  * (double) (n + 2) * c * b / 8.0;
+    const double zip = (double) filesize(out);
+    const double mb  = raw / (1024.0 * 1024.0);
+
+    printf("%4d rows: %lld pages ratio: %6.3f encode: %8.2f MB/s "
+                       "decode: %8.2f MB/s async: %8.2f MB/s\n", r, k,
+           zip > 0 ? raw / zip : 0.0,
+             e > 0 ? mb  / e   : 0.0,
+             d > 0 ? mb  / d   : 0.0,
+             w > 0 ? mb  / w   : 0.0);
+
+    // Report the outcomes of adaptive compression.
+
+    static const char *code_name[] = { "store", "fast", "full", "constant" };
+
+    for (int o = 0; o < 4; o++)
+        if (N[o])
+            printf("%14s: %lld pages ratio: %6.3f\n", code_name[o], N[o],
+                   C[o] > 0 ? (double) R[o] / (double) C[o] : 0.0);
+}
+
+//------------------------------------------------------------------------------
+
+// Sample conversion micro-benchmark. Time the encoding and decoding of a buffer
+// of random samples for each sample format, and the application and reversal of
+// the predictor for each channel count, using each supported instruction set.
+// Confirm that the results are bit-exact with the scalar reference.
+
+#define KN (1 << 20)
+#define KR 64
+
+static const char *simd_name[] = { "scalar", "sse2", "avx2", "avx512" };
+
+static void kernel(void)
+{
+    static const int B[6] = { 8, 16, 8, 16, 16, 32 };
+    static const int G[6] = { 0,  0, 1,  1,  2,  0 };
+
+    static const char *form_name[] = { "unsigned", "signed  ", "float   " };
+
+    float   *f = (float   *) malloc(KN * sizeof (float));
+    float   *u = (float   *) malloc(KN * sizeof (float));
+    float   *v = (float   *) malloc(KN * sizeof (float));
+    uint8_t *p = (uint8_t *) malloc(KN * sizeof (float));
+    uint8_t *q = (uint8_t *) malloc(KN * sizeof (float));
+
+    const int l = scm_simd_detect();
+
+    if (f && u && v && p && q)
+    {
+        // Cover the clamped range and beyond, along with NaN and infinities.
+
+        for (int i = 0; i < KN; i++)
+            f[i] = 2.5f * rand() / RAND_MAX - 1.25f;
+
+        f[0] = NAN;
+        f[1] = INFINITY;
+        f[2] = -INFINITY;
+        f[3] = -0.0f;
+
+        for (int k = 0; k < 6; k++)
+        {
+            const size_t z = (size_t) KN * (size_t) B[k] / 8;
+
+            ftob_scalar(q, f, KN, B[k], G[k]);
+            btof_scalar(q, v, KN, B[k], G[k]);
+
+            for (int j = SCM_SIMD_SCALAR; j <= l; j++)
+            {
+                double t0, t1, t2;
+
+                scm_simd_select(j);
+
+                t0 = now();
+                for (int r = 0; r < KR; r++)
+                    ftob(p, f, KN, B[k], G[k]);
+                t1 = now();
+                for (int r = 0; r < KR; r++)
+                    btof(p, u, KN, B[k], G[k]);
+                t2 = now();
+
+                printf("%2d bits %s %-6s ftob: %8.1f Ms/s btof: %8.1f Ms/s %s\n",
+                       B[k], form_name[B[k] == 32 ? 2 : G[k]], simd_name[j],
+                       (double) KN * KR / (t1 - t0) / 1e6,
+                       (double) KN * KR / (t2 - t1) / 1e6,
+                       (memcmp(p, q, z) == 0 &&
+                        memcmp(u, v, KN * sizeof (float)) == 0) ? "exact"
+                                                                : "MISMATCH");
+            }
+        }
+
+        // Time the predictor upon rows of 512 pixels plus border.
+
+        for (int k = 0; k < 2; k++)
+            for (int c = 1; c <= 4; c++)
+            {
+                const int    b = k ? 16 : 8;
+                const int    w = 514;
+                const int    h = KN / (w * c);
+                const size_t d = (size_t) w * c * b / 8;
+                const size_t z = (size_t) h * d;
+
+                memcpy(q, p, z);
+                for (int y = 0; y < h; y++)
+                    enhdif_scalar(q + y * d, w, c, b);
+                memcpy(v, q, z);
+                for (int y = 0; y < h; y++)
+                    dehdif_scalar((uint8_t *) v + y * d, w, c, b);
+
+                for (int j = SCM_SIMD_SCALAR; j <= l; j++)
+                {
+                    double te = 0, td = 0, t;
+                    bool   ok = true;
+
+                    scm_simd_select(j);
+
+                    for (int r = 0; r < KR; r++)
+                    {
+                        memcpy(u, p, z);
+                        t = now();
+                        for (int y = 0; y < h; y++)
+                            enhdif((uint8_t *) u + y * d, w, c, b);
+                        te += now() - t;
+                    }
+                    ok = ok && memcmp(u, q, z) == 0;
+
+                    for (int r = 0; r < KR; r++)
+                    {
+                        memcpy(u, q, z);
+                        t = now();
+                        for (int y = 0; y < h; y++)
+                            dehdif((uint8_t *) u + y * d, w, c, b);
+                        td += now() - t;
+                    }
+                    ok = ok && memcmp(u, v, z) == 0;
+
+                    printf("%2d bits %d channels %-6s enhdif: %8.1f MB/s "
+                                         "dehdif: %8.1f MB/s %s\n",
+                           b, c, simd_name[j],
+                           (double) z * KR / te / 1048576.0,
+                           (double) z * KR / td / 1048576.0,
+                           ok ? "exact" : "MISMATCH");
+                }
+            }
+    }
+    scm_simd_select(l);
+
+    free(q);
+    free(p);
+    free(v);
+    free(u);
+    free(f);
+}
+
+//------------------------------------------------------------------------------
+
+// Measure the effect of rows per strip upon each input. If r is zero, sweep
+// powers of two up to a single strip per page. If mode m is "kernel", run the
+// sample conversion micro-benchmark instead.
+
+int bench(int argc, char **argv, const char *o, const char *m, int r,
+                                                             const int *Z)
+{
+    const char *out = o ? o : "bench.tif";
+
+    if (m && strcmp(m, "kernel") == 0)
+    {
+        kernel();
+        return 0;
+    }
+
+    for (int i = 0; i < argc; i++)
+    {
+        scm   *s;
+        float *p;
+
+        if ((s = scm_ifile_io(argv[i], SCM_IO_PREAD)))
+        {
+            if (scm_scan_catalog(s) && (p = scm_alloc_buffer(s)))
+            {
+                const int h = scm_get_n(s) + 2;
+
+                printf("%s pixels: %d channels: %d bits: %d pages: %lld\n",
+                       argv[i], scm_get_n(s), scm_get_c(s), scm_get_b(s),
+                                              scm_get_length(s));
+                if (r)
+                    process(s, out, r, Z, p);
+                else
+                {
+                    for (int k = 1; k < h; k *= 2)
+                        process(s, out, k, Z, p);
+                    process(s, out, h, Z, p);
+                }
+                free(p);
+            }
+            scm_close(s);
+        }
+    }
+    remove(out);
+    return 0;
+}
+
+//------------------------------------------------------------------------------
@@ -47,218 +47,301 @@ static const  tofun translate_j[6][6] = {
     { topj, topj, tonj, tonj, NULL, topj },
 };
 
-static float *pixel(float *p, int n, int c, int i, int j)
+// Pages are framed in their native type, with e bytes per pixel, as the border
+// is only ever copied.
+
+static uint8_t *pixel(uint8_t *p, int n, int e, int i, int j)
 {
-    return p + c * (i * n + j);
+    return p + e * (i * n + j);
 }
 
-static void cpy(float *p, const float *q, int c)
+static void cpy(uint8_t *p, const uint8_t *q, int e)
 {
-    switch (c)
-    {
-        case 4: p[3] = q[3];
-        case 3: p[2] = q[2];
-        case 2: p[1] = q[1];
-        case 1: p[0] = q[0];
-    }
+    memcpy(p, q, (size_t) e);
 }
 
-static void copyn(float *p, long long x, float *q, long long y, int n, int c)
+static void copyn(uint8_t *p, long long x,
+                  uint8_t *q, long long y, int n, int e)
 {
     for (int j = 0; j < n; ++j)
-        cpy(pixel(p, n, c, 0, j),
-            pixel(q, n, c, translate_i[x][y](n - 2, j, n),
-                           translate_j[x][y](n - 2, j, n)), c);
+        cpy(pixel(p, n, e, 0, j),
+            pixel(q, n, e, translate_i[x][y](n - 2, j, n),
+                           translate_j[x][y](n - 2, j, n)), e);
 }
 
-static void copys(float *p, long long x, float *q, long long y, int n, int c)
+static void copys(uint8_t *p, long long x,
+                  uint8_t *q, long long y, int n, int e)
 {
     for (int j = 0; j < n; ++j)
-        cpy(pixel(p, n, c, n - 1, j),
-            pixel(q, n, c, translate_i[x][y](1, j, n),
-                           translate_j[x][y](1, j, n)), c);
+        cpy(pixel(p, n, e, n - 1, j),
+            pixel(q, n, e, translate_i[x][y](1, j, n),
+                           translate_j[x][y](1, j, n)), e);
 }
 
-static void copyw(float *p, long long x, float *q, long long y, int n, int c)
+static void copyw(uint8_t *p, long long x,
+                  uint8_t *q, long long y, int n, int e)
 {
     for (int i = 0; i < n; ++i)
-        cpy(pixel(p, n, c, i, 0),
-            pixel(q, n, c, translate_i[x][y](i, n - 2, n),
-                           translate_j[x][y](i, n - 2, n)), c);
+        cpy(pixel(p, n, e, i, 0),
+            pixel(q, n, e, translate_i[x][y](i, n - 2, n),
+                           translate_j[x][y](i, n - 2, n)), e);
 }
 
-static void copye(float *p, long long x, float *q, long long y, int n, int c)
+static void copye(uint8_t *p, long long x,
+                  uint8_t *q, long long y, int n, int e)
 {
     for (int i = 0; i < n; ++i)
-        cpy(pixel(p, n, c, i, n - 1),
-            pixel(q, n, c, translate_i[x][y](i, 1, n),
-                           translate_j[x][y](i, 1, n)), c);
+        cpy(pixel(p, n, e, i, n - 1),
+            pixel(q, n, e, translate_i[x][y](i, 1, n),
+                           translate_j[x][y](i, 1, n)), e);
 }
 
-static void copynw(float *p, long long x, float *q, long long y, int n, int c)
+static void copynw(uint8_t *p, long long x,
+                   uint8_t *q, long long y, int n, int e)
 {
     if (translate_i[x][y])
-        cpy(pixel(p, n, c, 0, 0),
-            pixel(q, n, c, translate_i[x][y](n - 2, n - 2, n),
-                           translate_j[x][y](n - 2, n - 2, n)), c);
+        cpy(pixel(p, n, e, 0, 0),
+            pixel(q, n, e, translate_i[x][y](n - 2, n - 2, n),
+                           translate_j[x][y](n - 2, n - 2, n)), e);
 }
 
-static void copyne(float *p, long long x, float *q, long long y, int n, int c)
+static void copyne(uint8_t *p, long long x,
+                   uint8_t *q, long long y, int n, int e)
 {
     if (translate_i[x][y])
-        cpy(pixel(p, n, c, 0, n - 1),
-            pixel(q, n, c, translate_i[x][y](n - 2, 1, n),
-                           translate_j[x][y](n - 2, 1, n)), c);
+        cpy(pixel(p, n, e, 0, n - 1),
+            pixel(q, n, e, translate_i[x][y](n - 2, 1, n),
+                           translate_j[x][y](n - 2, 1, n)), e);
 }
 
-static void copysw(float *p, long long x, float *q, long long y, int n, int c)
+static void copysw(uint8_t *p, long long x,
+                   uint8_t *q, long long y, int n, int e)
 {
     if (translate_i[x][y])
-        cpy(pixel(p, n, c, n - 1, 0),
-            pixel(q, n, c, translate_i[x][y](1, n - 2, n),
-                           translate_j[x][y](1, n - 2, n)), c);
+        cpy(pixel(p, n, e, n - 1, 0),
+            pixel(q, n, e, translate_i[x][y](1, n - 2, n),
+                           translate_j[x][y](1, n - 2, n)), e);
 }
 
-static void copyse(float *p, long long x, float *q, long long y, int n, int c)
+static void copyse(uint8_t *p, long long x,
+                   uint8_t *q, long long y, int n, int e)
 {
     if (translate_i[x][y])
-        cpy(pixel(p, n, c, n - 1, n - 1),
-            pixel(q, n, c, translate_i[x][y](1, 1, n),
-                           translate_j[x][y](1, 1, n)), c);
+        cpy(pixel(p, n, e, n - 1, n - 1),
+            pixel(q, n, e, translate_i[x][y](1, 1, n),
+                           translate_j[x][y](1, 1, n)), e);
 }
 
-static void dilate(float *p, int n, int c)
+static void dilate(uint8_t *p, int n, int e)
 {
     for (int i = 1; i < n - 1; i++)
     {
-        cpy(pixel(p, n, c, i,     0), pixel(p, n, c, i,     1), c);
-        cpy(pixel(p, n, c, i, n - 1), pixel(p, n, c, i, n - 2), c);
+        cpy(pixel(p, n, e, i,     0), pixel(p, n, e, i,     1), e);
+        cpy(pixel(p, n, e, i, n - 1), pixel(p, n, e, i, n - 2), e);
 
-        cpy(pixel(p, n, c,     0, i), pixel(p, n, c,     1, i), c);
-        cpy(pixel(p, n, c, n - 1, i), pixel(p, n, c, n - 2, i), c);
+        cpy(pixel(p, n, e,     0, i), pixel(p, n, e,     1, i), e);
+        cpy(pixel(p, n, e, n - 1, i), pixel(p, n, e, n - 2, i), e);
     }
 
-    cpy(pixel(p, n, c,     0,     0), pixel(p, n, c,     1,     1), c);
-    cpy(pixel(p, n, c, n - 1,     0), pixel(p, n, c, n - 2,     1), c);
-    cpy(pixel(p, n, c,     0, n - 1), pixel(p, n, c,     1, n - 2), c);
-    cpy(pixel(p, n, c, n - 1, n - 1), pixel(p, n, c, n - 2, n - 2), c);
+    cpy(pixel(p, n, e,     0,     0), pixel(p, n, e,     1,     1), e);
+    cpy(pixel(p, n, e, n - 1,     0), pixel(p, n, e, n - 2,     1), e);
+    cpy(pixel(p, n, e,     0, n - 1), pixel(p, n, e,     1, n - 2), e);
+    cpy(pixel(p, n, e, n - 1, n - 1), pixel(p, n, e, n - 2, n - 2), e);
 }
 
-static void process(scm *s, scm *t)
+// Read into q the part of the page at offset o of SCM s spanning the samples at
+// (i0, j0) and (i1, j1), as addressed from a page with root x when the page has
+// root y. Only the strips or tiles holding those samples are decoded.
+
+static bool fetch(scm *s, long long o, uint8_t *q, long long x, long long y,
+                  int i0, int j0, int i1, int j1, int n)
+{
+    if (o && translate_i[x][y])
+    {
+        const int ia = translate_i[x][y](i0, j0, n);
+        const int ja = translate_j[x][y](i0, j0, n);
+        const int ib = translate_i[x][y](i1, j1, n);
+        const int jb = translate_j[x][y](i1, j1, n);
+
+        return scm_read_region_raw(s, o, min(ja, jb),     min(ia, ib),
+                                         max(ja, jb) + 1, max(ia, ib) + 1, q);
+    }
+    return false;
+}
+
+// Read page i of SCM s into buffer p and fill its border using data from all
+// neighboring pages, read into scratch buffer q. Return the page index.
+
+static long long frame(scm *s, long long i, uint8_t *p, uint8_t *q)
 {
     const int o = scm_get_n(s) + 2;
-    const int c = scm_get_c(s);
+    const int e = scm_get_c(s) * scm_get_b(s) / 8;
 
+    if (scm_read_page_raw(s, scm_get_offset(s, i), p))
+    {
+        // Copy outer data onto the border as fallback for missing.
+
+        dilate(p, o, e);
+
+        // Determine the page indices of all neighboring pages.
+
+        long long x   = scm_get_index(s, i);
+
+        long long xn  = scm_page_north(x);
+        long long xs  = scm_page_south(x);
+        long long xw  = scm_page_west (x);
+        long long xe  = scm_page_east (x);
+
+        // Determine their roots.
+
+        long long f   = scm_page_root(x);
+        long long fn  = scm_page_root(xn);
+        long long fs  = scm_page_root(xs);
+        long long fw  = scm_page_root(xw);
+        long long fe  = scm_page_root(xe);
+
+        // Use roots to guide the determination of diagonals.
+
+        long long xnw = (fn == f) ? scm_page_west (xn)
+                                  : scm_page_north(xw);
+        long long xne = (fn == f) ? scm_page_east (xn)
+                                  : scm_page_north(xe);
+        long long xsw = (fs == f) ? scm_page_west (xs)
+                                  : scm_page_south(xw);
+        long long xse = (fs == f) ? scm_page_east (xs)
+                                  : scm_page_south(xe);
+
+        // Seek the page catalog locations of all neighbors.
+
+        long long in  = scm_search(s, xn);
+        long long is  = scm_search(s, xs);
+        long long iw  = scm_search(s, xw);
+        long long ie  = scm_search(s, xe);
+        long long inw = scm_search(s, xnw);
+        long long ine = scm_search(s, xne);
+        long long isw = scm_search(s, xsw);
+        long long ise = scm_search(s, xse);
+
+        // Get the file offset of all pages.
+
+        long long on  = (in  < 0) ? 0 : scm_get_offset(s, in);
+        long long os  = (is  < 0) ? 0 : scm_get_offset(s, is);
+        long long ow  = (iw  < 0) ? 0 : scm_get_offset(s, iw);
+        long long oe  = (ie  < 0) ? 0 : scm_get_offset(s, ie);
+        long long onw = (inw < 0) ? 0 : scm_get_offset(s, inw);
+        long long one = (ine < 0) ? 0 : scm_get_offset(s, ine);
+        long long osw = (isw < 0) ? 0 : scm_get_offset(s, isw);
+        long long ose = (ise < 0) ? 0 : scm_get_offset(s, ise);
+
+        long long v[8] = { on, os, ow, oe, onw, one, osw, ose };
+
+        scm_prefetch(s, v, 8);
+
+        // Copy the borders of all adjacent pages into this one.
+
+        if (fetch(s, on, q, f, fn, o - 2, 0, o - 2, o - 1, o))
+            copyn(p, f, q, fn, o, e);
+        if (fetch(s, os, q, f, fs, 1,     0, 1,     o - 1, o))
+            copys(p, f, q, fs, o, e);
+        if (fetch(s, ow, q, f, fw, 0, o - 2, o - 1, o - 2, o))
+            copyw(p, f, q, fw, o, e);
+        if (fetch(s, oe, q, f, fe, 0,     1, o - 1,     1, o))
+            copye(p, f, q, fe, o, e);
+
+        // Copy the corners of all diagonal pages into this one.
+
+        long long fnw = scm_page_root(xnw);
+        long long fne = scm_page_root(xne);
+        long long fsw = scm_page_root(xsw);
+        long long fse = scm_page_root(xse);
+
+        if (fetch(s, onw, q, f, fnw, o - 2, o - 2, o - 2, o - 2, o))
+            copynw(p, f, q, fnw, o, e);
+        if (fetch(s, one, q, f, fne, o - 2,     1, o - 2,     1, o))
+            copyne(p, f, q, fne, o, e);
+        if (fetch(s, osw, q, f, fsw, 1,     o - 2, 1,     o - 2, o))
+            copysw(p, f, q, fsw, o, e);
+        if (fetch(s, ose, q, f, fse, 1,         1, 1,         1, o))
+            copyse(p, f, q, fse, o, e);
+
+        return x;
+    }
+    return -1;
+}
+
+// Frame all pages of SCM s and append them to SCM t. Pages are framed K at a
+// time in parallel, each using its own reader, and then appended in order.
+
+#define K 16
+
+static void process(scm *s, scm *t)
+{
     long long b = 0;
-    float    *p;
-    float    *q;
 
     if (scm_scan_catalog(s))
     {
         report_init((int) scm_get_length(s));
 
-        if ((p = scm_alloc_buffer(s)) && (q = scm_alloc_buffer(t)))
+        // Allocate readers and image buffers.
+
+        scm     *r[K];
+        uint8_t *p[K];
+        uint8_t *q[K];
+        int      k;
+        int      j;
+
+        for (k = 0; k < K; ++k)
         {
-            for (long long i = 0; i < scm_get_length(s); ++i)
+            r[k] = NULL;
+            p[k] = NULL;
+            q[k] = NULL;
+        }
+        for (k = 0; k < K; ++k)
+            if ((r[k] = scm_reader(s)) == NULL ||
+                (p[k] = (uint8_t *) scm_alloc_raw_buffer(s)) == NULL ||
+                (q[k] = (uint8_t *) scm_alloc_raw_buffer(s)) == NULL)
+                break;
+
+        if (k == K)
+        {
+            long long l = scm_get_length(s);
+
+            for (long long i = 0; i < l; i += K)
             {
-                if (scm_read_page(s, scm_get_offset(s, i), p))
+                long long x[K];
+
+                j = (int) min(l - i, K);
+
+                // Frame the next K pages in parallel.
+
+                #pragma omp parallel for
+                for (k = 0; k < j; ++k)
+                    x[k] = frame(r[k], i + k, p[k], q[k]);
+
+                // Write the resulting pages to the output.
+
+                for (k = 0; k < j; ++k)
                 {
-                    // Copy outer data onto the border as fallback for missing.
-
-                    dilate(p, o, c);
-
-                    // Determine the page indices of all neighboring pages.
-
-                    long long x   = scm_get_index(s, i);
-
-                    long long xn  = scm_page_north(x);
-                    long long xs  = scm_page_south(x);
-                    long long xw  = scm_page_west (x);
-                    long long xe  = scm_page_east (x);
-
-                    // Determine their roots.
-
-                    long long f   = scm_page_root(x);
-                    long long fn  = scm_page_root(xn);
-                    long long fs  = scm_page_root(xs);
-                    long long fw  = scm_page_root(xw);
-                    long long fe  = scm_page_root(xe);
-
-                    // Use roots to guide the determination of diagonals.
-
-                    long long xnw = (fn == f) ? scm_page_west (xn)
-                                              : scm_page_north(xw);
-                    long long xne = (fn == f) ? scm_page_east (xn)
-                                              : scm_page_north(xe);
-                    long long xsw = (fs == f) ? scm_page_west (xs)
-                                              : scm_page_south(xw);
-                    long long xse = (fs == f) ? scm_page_east (xs)
-                                              : scm_page_south(xe);
-
-                    // Seek the page catalog locations of all neighbors.
-
-                    long long in  = scm_search(s, xn);
-                    long long is  = scm_search(s, xs);
-                    long long iw  = scm_search(s, xw);
-                    long long ie  = scm_search(s, xe);
-                    long long inw = scm_search(s, xnw);
-                    long long ine = scm_search(s, xne);
-                    long long isw = scm_search(s, xsw);
-                    long long ise = scm_search(s, xse);
-
-                    // Get the file offset of all pages.
-
-                    long long on  = (in  < 0) ? 0 : scm_get_offset(s, in);
-                    long long os  = (is  < 0) ? 0 : scm_get_offset(s, is);
-                    long long ow  = (iw  < 0) ? 0 : scm_get_offset(s, iw);
-                    long long oe  = (ie  < 0) ? 0 : scm_get_offset(s, ie);
-                    long long onw = (inw < 0) ? 0 : scm_get_offset(s, inw);
-                    long long one = (ine < 0) ? 0 : scm_get_offset(s, ine);
-                    long long osw = (isw < 0) ? 0 : scm_get_offset(s, isw);
-                    long long ose = (ise < 0) ? 0 : scm_get_offset(s, ise);
-
-                    // Copy the borders of all adjacent pages into this one.
-
-                    if (on && scm_read_page(s, on, q))
-                        copyn(p, f, q, fn, o, c);
-                    if (os && scm_read_page(s, os, q))
-                        copys(p, f, q, fs, o, c);
-                    if (ow && scm_read_page(s, ow, q))
-                        copyw(p, f, q, fw, o, c);
-                    if (oe && scm_read_page(s, oe, q))
-                        copye(p, f, q, fe, o, c);
-
-                    // Copy the corners of all diagonal pages into this one.
-
-                    long long fnw = scm_page_root(xnw);
-                    long long fne = scm_page_root(xne);
-                    long long fsw = scm_page_root(xsw);
-                    long long fse = scm_page_root(xse);
-
-                    if (onw && scm_read_page(s, onw, q))
-                        copynw(p, f, q, fnw, o, c);
-                    if (one && scm_read_page(s, one, q))
-                        copyne(p, f, q, fne, o, c);
-                    if (osw && scm_read_page(s, osw, q))
-                        copysw(p, f, q, fsw, o, c);
-                    if (ose && scm_read_page(s, ose, q))
-                        copyse(p, f, q, fse, o, c);
-
-                    // Write the resulting page to the output.
-
-                    b = scm_append(t, b, x, p);
+                    if (x[k] >= 0)
+                        b = scm_append_raw(t, b, x[k], p[k]);
+
+                    report_step();
                 }
-                report_step();
             }
-            free(q);
-            free(p);
+        }
+
+        for (k = 0; k < K; ++k)
+        {
+            scm_close(r[k]);
+            free(q[k]);
+            free(p[k]);
         }
     }
 }
 
 //------------------------------------------------------------------------------
 
-int border(int argc, char **argv, const char *o)
+int border(int argc, char **argv, const char *o, int C, const int *Z)
 {
     if (argc > 0)
     {
@@ -267,16 +350,26 @@ int border(int argc, char **argv, const char *o)
         scm *s = NULL;
         scm *t = NULL;
 
-        if ((s = scm_ifile(argv[0])))
+        if ((s = scm_ifile_io(argv[0], SCM_IO_MMAP)))
         {
             int n = scm_get_n(s);
             int c = scm_get_c(s);
             int b = scm_get_b(s);
             int g = scm_get_g(s);
+            int r = scm_get_r(s);
 
-            if ((t = scm_ofile(out, n, c, b, g)))
+            if ((t = scm_ofile_io(out, n, c, b, g, r, SCM_IO_PREAD)))
             {
-                process(s, t);
+                if (scm_set_tile(t, scm_get_t(s)) &&
+                    scm_set_compression(t, Z[0] ? Z[0] : scm_get_z(s),
+                                           Z[0] ? Z[1] : scm_get_l(s)))
+                {
+                    scm_set_constant(t, Z[2]);
+                    scm_set_cache(s, (size_t) C << 20);
+                    scm_access   (s, SCM_ACCESS_RANDOM);
+                    scm_write_behind(t, 4);
+                    process(s, t);
+                }
                 scm_close(t);
             }
             scm_close(s);
@@ -47,6 +47,50 @@ static inline void blend(float *dst, const float *src, int c)
     dst[c - 1] = max(dst[c - 1], src[c - 1]);
 }
 
+// Sum or take the maximum of n integer samples of type T in their native form,
+// accumulating in type U. Sums saturate at the range limits lo and hi of the
+// type, as they do when converted from float.
+
+#define COMBINE_RAW(name, T, U, lo, hi)                                        \
+static void name(void *p, const void *q, size_t n, int O)                     \
+{                                                                              \
+    T       *pp = (T       *) p;                                               \
+    const T *qq = (const T *) q;                                               \
+                                                                               \
+    if (O == 0)                                                                \
+        for (size_t j = 0; j < n; ++j)                                         \
+            pp[j] = (T) max(min((U) pp[j] + (U) qq[j], hi), lo);               \
+    else                                                                       \
+        for (size_t j = 0; j < n; ++j)                                         \
+            pp[j] = max(pp[j], qq[j]);                                         \
+}
+
+COMBINE_RAW(combine_u8,  uint8_t,  int,      0,   255)
+COMBINE_RAW(combine_s8,  int8_t,   int,   -127,   127)
+COMBINE_RAW(combine_u16, uint16_t, int,      0, 65535)
+COMBINE_RAW(combine_s16, int16_t,  int, -32767, 32767)
+
+typedef void (*combine_fn)(void *, const void *, size_t, int);
+
+// Return the native combiner for operation O on the samples of SCM s, or NULL
+// if there is none and samples must be combined as floats. Only the sum and
+// maximum of integer samples are supported.
+
+static combine_fn combine_native(scm *s, int O)
+{
+    const int b = scm_get_b(s);
+    const int g = scm_get_g(s);
+
+    if (O == 0 || O == 1)
+    {
+        if (b ==  8 && g == 0) return combine_u8;
+        if (b ==  8 && g == 1) return combine_s8;
+        if (b == 16 && g == 0) return combine_u16;
+        if (b == 16 && g == 1) return combine_s16;
+    }
+    return NULL;
+}
+
 //------------------------------------------------------------------------------
 
 // Attempt to read and map the SCM TIFF with the given name. If successful,
@@ -114,6 +158,17 @@ static void process(scm *s, scm **V, int C, int O)
 
         report_init(m);
 
+        // Pages may be handled in their native type if all share the output's.
+
+        bool R = true;
+
+        for (int f = 0; f < C; ++f)
+            if (scm_get_b(V[f]) != scm_get_b(s) ||
+                scm_get_g(V[f]) != scm_get_g(s))
+                R = false;
+
+        combine_fn F = R ? combine_native(s, O) : NULL;
+
         // Process each page of an SCM with the desired depth.
 
         for (int x = 0; x <= m; ++x)
@@ -135,13 +190,39 @@ static void process(scm *s, scm **V, int C, int O)
                     k++;
                 }
 
-            // If there is exactly one contributor, repeat its page.
+            // If there is exactly one contributor, repeat its page, or copy
+            // it if its sample type, strip or tile layout, or compression
+            // differs from the output's.
 
-            if (k == 1)
+            if (k == 1 && R && scm_get_r(V[g]) == scm_get_r(s)
+                       && scm_get_t(V[g]) == scm_get_t(s)
+                       && scm_get_z(V[g]) == scm_get_z(s))
                 b = scm_repeat(s, b, V[g], o[g]);
 
-            // If there is more than one, append their summed pages.
+            else if (k == 1 && R)
+            {
+                if (scm_read_page_raw(V[g], o[g], p))
+                    b = scm_append_raw(s, b, x, p);
+            }
+            else if (k == 1)
+            {
+                if (scm_read_page(V[g], o[g], p))
+                    b = scm_append(s, b, x, p);
+            }
+
+            // If there is more than one, append their summed pages, in their
+            // native type if possible.
 
+            else if (k > 1 && F)
+            {
+                memset(p, 0, scm_page_size(s, true));
+
+                for (int f = 0; f < C; ++f)
+                    if (o[f] && scm_read_page_raw(V[f], o[f], q))
+                        F(p, q, S, O);
+
+                b = scm_append_raw(s, b, x, p);
+            }
             else if (k > 1)
             {
                 memset(p, 0, S * sizeof (float));
@@ -182,7 +263,7 @@ static void process(scm *s, scm **V, int C, int O)
 
 //------------------------------------------------------------------------------
 
-int combine(int argc, char **argv, const char *o, const char *m)
+int combine(int argc, char **argv, const char *o, const char *m, const int *Z)
 {
     scm **V = NULL;
     int   C = 0;
@@ -209,12 +290,20 @@ int combine(int argc, char **argv, const char *o, const char *m)
             int c = scm_get_c(V[0]);
             int b = scm_get_b(V[0]);
             int g = scm_get_g(V[0]);
+            int r = scm_get_r(V[0]);
 
             scm *s;
 
-            if ((s = scm_ofile(out, n, c, b, g)))
+            if ((s = scm_ofile_io(out, n, c, b, g, r, SCM_IO_PREAD)))
             {
-                process(s, V, C, O);
+                if (scm_set_tile(s, scm_get_t(V[0])) &&
+                    scm_set_compression(s, Z[0] ? Z[0] : scm_get_z(V[0]),
+                                           Z[0] ? Z[1] : scm_get_l(V[0])))
+                {
+                    scm_set_constant(s, Z[2]);
+                    scm_write_behind(s, 4);
+                    process(s, V, C, O);
+                }
                 scm_close(s);
             }
         }
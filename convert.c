@@ -237,7 +237,10 @@ int convert(int argc, char **argv, const char *o,
                                            int d,
                                            int b,
                                            int g,
+                                           int r,
+                                           int t,
                                            int A,
+                                 const int    *Z,
                                  const float  *N,
                                  const double *E,
                                  const double *L,
@@ -322,6 +325,11 @@ int convert(int argc, char **argv, const char *o,
                 if (g) { p->norm0 = 0.0f; p->norm1 =   127.0f; }
                 else   { p->norm0 = 0.0f; p->norm1 =   255.0f; }
             }
+            else if (b == 16 && g == 2)
+            {
+                p->norm0 = 0.0f;
+                p->norm1 = 1.0f;
+            }
             else if (b == 16)
             {
                 if (g) { p->norm0 = 0.0f; p->norm1 = 32767.0f; }
@@ -335,9 +343,15 @@ int convert(int argc, char **argv, const char *o,
 
             // Process the output.
 
-            if ((s = scm_ofile(out, n, p->c + A, b, g)))
+            if ((s = scm_ofile_io(out, n, p->c + A, b, g, r, SCM_IO_PREAD)))
             {
-                process(s, d, p);
+                if (scm_set_tile(s, t) &&
+                    (Z[0] == 0 || scm_set_compression(s, Z[0], Z[1])))
+                {
+                    scm_set_constant(s, Z[2]);
+                    scm_write_behind(s, 4);
+                    process(s, d, p);
+                }
                 scm_close(s);
             }
             img_close(p);
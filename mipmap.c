@@ -43,7 +43,7 @@ static void max_pixels(float *p, const float *q0, const float *q1,
         case 4: p[3] = max(max(q0[3], q1[3]), max(q2[3], q3[3]));
         case 3: p[2] = max(max(q0[2], q1[2]), max(q2[2], q3[2]));
         case 2: p[1] = max(max(q0[1], q1[1]), max(q2[1], q3[1]));
-        case 1: p[0] = max(max(q0[0], q1[1]), max(q2[0], q3[0]));
+        case 1: p[0] = max(max(q0[0], q1[0]), max(q2[0], q3[0]));
     }
 }
 
@@ -95,9 +95,122 @@ static void box(float *p, int ki, int kj, int c, int n, int O, float *q)
 
 //------------------------------------------------------------------------------
 
+// Box filter one 2-by-2 block of integer samples of type T in their native
+// form, accumulating in type U. Sums saturate at the range limits lo and hi of
+// the type, as they do when converted from float, and averages truncate toward
+// zero.
+
+#define BOX_RAW(name, T, U, lo, hi)                                            \
+static void name(void *p, int ki, int kj,                                      \
+                 int qi, int qj, int c, int n, int O, const void *q)           \
+{                                                                              \
+    const int pi = qi / 2 + ki * n / 2;                                        \
+    const int pj = qj / 2 + kj * n / 2;                                        \
+                                                                               \
+    const T *q0 = (const T *) q + ((n + 2) * (qi + 1) + (qj + 1)) * c;         \
+    const T *q1 = (const T *) q + ((n + 2) * (qi + 1) + (qj + 2)) * c;         \
+    const T *q2 = (const T *) q + ((n + 2) * (qi + 2) + (qj + 1)) * c;         \
+    const T *q3 = (const T *) q + ((n + 2) * (qi + 2) + (qj + 2)) * c;         \
+    T       *pp = (T       *) p + ((n + 2) * (pi + 1) + (pj + 1)) * c;         \
+                                                                               \
+    for (int k = 0; k < c; k++)                                                \
+    {                                                                          \
+        const U v = (U) q0[k] + (U) q1[k] + (U) q2[k] + (U) q3[k];             \
+                                                                               \
+        switch (O)                                                             \
+        {                                                                      \
+            case 0: pp[k] = (T) max(min(v, hi), lo);                  break;   \
+            case 1: pp[k] = max(max(q0[k], q1[k]), max(q2[k], q3[k])); break;  \
+            case 2: pp[k] = (T) (v / 4);                              break;   \
+        }                                                                      \
+    }                                                                          \
+}
+
+BOX_RAW(box_u8,  uint8_t,  int,      0,   255)
+BOX_RAW(box_s8,  int8_t,   int,   -127,   127)
+BOX_RAW(box_u16, uint16_t, int,      0, 65535)
+BOX_RAW(box_s16, int16_t,  int, -32767, 32767)
+
+typedef void (*box_fn)(void *, int, int, int, int, int, int, int, const void *);
+
+// Box filter the native n-by-n image buffer q into quadrant (ki, kj) of p using
+// block filter f.
+
+static void box_raw(void *p, int ki, int kj, int c, int n, int O,
+                                               const void *q, box_fn f)
+{
+    int qi;
+    int qj;
+
+    #pragma omp parallel for private(qj)
+    for     (qi = 0; qi < n; qi += 2)
+        for (qj = 0; qj < n; qj += 2)
+            f(p, ki, kj, qi, qj, c, n, O, q);
+}
+
+// Return the native block filter for the samples of SCM s, or NULL if there is
+// none and samples must be filtered as floats. Growth requires floats.
+
+static box_fn box_native(scm *s, int A)
+{
+    const int b = scm_get_b(s);
+    const int g = scm_get_g(s);
+
+    if (A == 0)
+    {
+        if (b ==  8 && g == 0) return box_u8;
+        if (b ==  8 && g == 1) return box_s8;
+        if (b == 16 && g == 0) return box_u16;
+        if (b == 16 && g == 1) return box_s16;
+    }
+    return NULL;
+}
+
+//------------------------------------------------------------------------------
+
+// Fill page buffer p with the down-sampled data of the children at offsets o,
+// reading them using SCM reader r into scratch buffer q. If native block filter
+// f is given, the pages are read and filtered without conversion to float.
+
+static void filter(scm *r, const long long *o, int O, int A, box_fn f,
+                                                   float *p, float *q)
+{
+    const int n = scm_get_n(r);
+    const int c = scm_get_c(r);
+
+    if (f)
+    {
+        memset(p, 0, scm_page_size(r, true));
+
+        if (o[0] && scm_read_page_raw(r, o[0], q))
+            box_raw(p, 0, 0, c, n, O, q, f);
+        if (o[1] && scm_read_page_raw(r, o[1], q))
+            box_raw(p, 0, 1, c, n, O, q, f);
+        if (o[2] && scm_read_page_raw(r, o[2], q))
+            box_raw(p, 1, 0, c, n, O, q, f);
+        if (o[3] && scm_read_page_raw(r, o[3], q))
+            box_raw(p, 1, 1, c, n, O, q, f);
+    }
+    else
+    {
+        memset(p, 0, scm_page_size(r, false));
+
+        if (o[0] && scm_read_page(r, o[0], q)) box(p, 0, 0, c, n, O, q);
+        if (o[1] && scm_read_page(r, o[1], q)) box(p, 0, 1, c, n, O, q);
+        if (o[2] && scm_read_page(r, o[2], q)) box(p, 1, 0, c, n, O, q);
+        if (o[3] && scm_read_page(r, o[3], q)) box(p, 1, 1, c, n, O, q);
+
+        if (A) grow(p, q, c, n);
+    }
+}
+
 // Scan SCM s seeking any page that is not present, but which has at least one
 // child present. Fill such pages using down-sampled child data and append them.
-// Return the number of pages added, so we can stop when there are none.
+// Pages are filtered K at a time in parallel, each using its own reader, and
+// then appended in order. Return the number of pages added, so we can stop
+// when there are none.
+
+#define K 16
 
 static long long process(scm *s, int O, int A)
 {
@@ -114,59 +227,82 @@ static long long process(scm *s, int O, int A)
             if (b < scm_get_offset(s, i))
                 b = scm_get_offset(s, i);
 
-        // Allocate image buffers.
+        // Allocate readers and image buffers.
 
-        float *p;
-        float *q;
+        scm   *r[K];
+        float *p[K];
+        float *q[K];
+        int    k;
+        int    j;
 
-        if ((p = scm_alloc_buffer(s)) && (q = scm_alloc_buffer(s)))
+        box_fn f = box_native(s, A);
+
+        for (k = 0; k < K; ++k)
         {
-            for (long long x = 0; x < scm_get_index(s, 0); ++x)
-            {
-                // Calculate the page indices for all children of x.
+            r[k] = NULL;
+            p[k] = NULL;
+            q[k] = NULL;
+        }
+        for (k = 0; k < K; ++k)
+            if ((r[k] = scm_reader(s))       == NULL ||
+                (p[k] = scm_alloc_buffer(s)) == NULL ||
+                (q[k] = scm_alloc_buffer(s)) == NULL)
+                break;
 
-                long long x0 = scm_page_child(x, 0);
-                long long x1 = scm_page_child(x, 1);
-                long long x2 = scm_page_child(x, 2);
-                long long x3 = scm_page_child(x, 3);
+        if (k == K)
+        {
+            long long m = scm_get_index(s, 0);
+            long long x = 0;
 
-                // Seek the catalog location of each page index.
+            while (x < m)
+            {
+                long long X[K];
+                long long o[K][4];
 
-                long long i1 = scm_search(s, x1);
-                long long i2 = scm_search(s, x2);
-                long long i3 = scm_search(s, x3);
-                long long i0 = scm_search(s, x0);
+                // Gather up to K pages with at least one child present.
 
-                // Determine the file offset of each page.
+                for (j = 0; j < K && x < m; ++x)
+                {
+                    // Seek the catalog location and file offset of each child.
 
-                long long o0 = (i0 < 0) ? 0 : scm_get_offset(s, i0);
-                long long o1 = (i1 < 0) ? 0 : scm_get_offset(s, i1);
-                long long o2 = (i2 < 0) ? 0 : scm_get_offset(s, i2);
-                long long o3 = (i3 < 0) ? 0 : scm_get_offset(s, i3);
+                    for (int c = 0; c < 4; ++c)
+                    {
+                        long long i = scm_search(s, scm_page_child(x, c));
 
-                // Contribute any found offsets to the output.
+                        o[j][c] = (i < 0) ? 0 : scm_get_offset(s, i);
+                    }
 
-                if (o0 || o1 || o2 || o3)
-                {
-                    const int o = scm_get_n(s) + 2;
-                    const int n = scm_get_n(s);
-                    const int c = scm_get_c(s);
+                    if (o[j][0] || o[j][1] || o[j][2] || o[j][3])
+                    {
+                        scm_prefetch(s, o[j], 4);
+                        X[j++] = x;
+                    }
+                }
 
-                    memset(p, 0, (size_t) (o * o * c) * sizeof (float));
+                // Filter the gathered pages in parallel.
 
-                    if (o0 && scm_read_page(s, o0, q)) box(p, 0, 0, c, n, O, q);
-                    if (o1 && scm_read_page(s, o1, q)) box(p, 0, 1, c, n, O, q);
-                    if (o2 && scm_read_page(s, o2, q)) box(p, 1, 0, c, n, O, q);
-                    if (o3 && scm_read_page(s, o3, q)) box(p, 1, 1, c, n, O, q);
+                #pragma omp parallel for
+                for (k = 0; k < j; ++k)
+                    filter(r[k], o[k], O, A, f, p[k], q[k]);
 
-                    if (A) grow(p, q, c, n);
+                // Append the results in order.
 
-                    b = scm_append(s, b, x, p);
+                for (k = 0; k < j; ++k)
+                {
+                    if (f)
+                        b = scm_append_raw(s, b, X[k], p[k]);
+                    else
+                        b = scm_append    (s, b, X[k], p[k]);
                     t++;
                 }
             }
-            free(q);
-            free(p);
+        }
+
+        for (k = 0; k < K; ++k)
+        {
+            scm_close(r[k]);
+            free(q[k]);
+            free(p[k]);
         }
     }
     return t;
@@ -174,7 +310,8 @@ static long long process(scm *s, int O, int A)
 
 //------------------------------------------------------------------------------
 
-int mipmap(int argc, char **argv, const char *o, const char *m, int A)
+int mipmap(int argc, char **argv, const char *o, const char *m, int A,
+                                                              const int *Z)
 {
     int O = 2;
 
@@ -189,12 +326,19 @@ int mipmap(int argc, char **argv, const char *o, const char *m, int A)
     {
         scm *s = NULL;
 
-        if ((s = scm_ifile(argv[0])))
+        if ((s = scm_ifile_io(argv[0], SCM_IO_PREAD)))
         {
             long long c;
 
-            while ((c = process(s, O, A)))
-                ;
+            if (Z[0] == 0 || scm_set_compression(s, Z[0], Z[1]))
+            {
+                scm_set_constant(s, Z[2]);
+                scm_write_behind(s, 4);
+                scm_access(s, SCM_ACCESS_RANDOM);
+
+                while ((c = process(s, O, A)))
+                    ;
+            }
 
             scm_close(s);
         }
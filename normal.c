@@ -101,41 +101,35 @@ static void sampnorm(int f, int i, int j, int n, int c,
     o[2] = ((float) nn[2] + 1.f) / 2.f;
 }
 
-// Recursively traverse the tree at page x, reading input pages from SCM s and
-// computing normal map output pages for SCM t.
+// A page to be processed, with its location in the subdivision of its root.
 
-static long long divide(scm *s, long long x,
-                        scm *t, long long b,
-                        long u, long v, long w,
-                        const float *r, float *p, float *q)
+struct page
+{
+    long long x;
+    long long o;
+    long u;
+    long v;
+    long w;
+};
+
+// Recursively traverse the tree at page x of SCM s, listing all present pages
+// in depth-first order. Return the new length of the list.
+
+static long long divide(scm *s, long long x, long u, long v, long w,
+                        struct page *a, long long c)
 {
     long long i;
 
     if ((i = scm_search(s, x)) >= 0)
     {
-        long long o = scm_get_offset(s, i);
-
-        // Generate the normal map for page x.
-
-        if (scm_read_page(s, o, p))
-        {
-            const int f = (int) scm_page_root(x);
-            const int n = scm_get_n(s);
-            const int c = scm_get_c(s);
-            int i;
-            int j;
-
-            #pragma omp parallel for private(j)
-            for     (i = 0; i < n; ++i)
-                for (j = 0; j < n; ++j)
-                    sampnorm(f, i, j, n, c, u, v, w, r, p, q);
-
-            b = scm_append(t, b, x, q);
-
-            report_step();
-        }
+        a[c].x = x;
+        a[c].o = scm_get_offset(s, i);
+        a[c].u = u;
+        a[c].v = v;
+        a[c].w = w;
+        c++;
 
-        // Generate normal maps for the children of page x.
+        // List the children of page x.
 
         long long x0 = scm_page_child(x, 0);
         long long x1 = scm_page_child(x, 1);
@@ -145,49 +139,123 @@ static long long divide(scm *s, long long x,
         long u0 = u * 2, u1 = u0 + 1;
         long v0 = v * 2, v1 = v0 + 1;
 
-        if (x0) b = divide(s, x0, t, b, u0, v0, 2 * w, r, p, q);
-        if (x1) b = divide(s, x1, t, b, u0, v1, 2 * w, r, p, q);
-        if (x2) b = divide(s, x2, t, b, u1, v0, 2 * w, r, p, q);
-        if (x3) b = divide(s, x3, t, b, u1, v1, 2 * w, r, p, q);
+        if (x0) c = divide(s, x0, u0, v0, 2 * w, a, c);
+        if (x1) c = divide(s, x1, u0, v1, 2 * w, a, c);
+        if (x2) c = divide(s, x2, u1, v0, 2 * w, a, c);
+        if (x3) c = divide(s, x3, u1, v1, 2 * w, a, c);
     }
-    return b;
+    return c;
 }
 
-// Query the offsets of all pages in SCM s. Allocate I/O scratch buffers and
-// initiate the recursive traversal of all pages.
+// Read page a using SCM reader s into buffer p and compute its normal map in
+// buffer q. Return true on success.
+
+static bool compute(scm *s, const struct page *a, const float *r,
+                                                    float *p, float *q)
+{
+    if (scm_read_page(s, a->o, p))
+    {
+        const int f = (int) scm_page_root(a->x);
+        const int n = scm_get_n(s);
+        const int c = scm_get_c(s);
+        int i;
+        int j;
+
+        #pragma omp parallel for private(j)
+        for     (i = 0; i < n; ++i)
+            for (j = 0; j < n; ++j)
+                sampnorm(f, i, j, n, c, a->u, a->v, a->w, r, p, q);
+
+        return true;
+    }
+    return false;
+}
+
+// Query the offsets of all pages in SCM s and list them in traversal order.
+// Compute normal maps K pages at a time in parallel, each using its own reader,
+// and append them to SCM t in order.
+
+#define K 16
 
 static void process(scm *s, scm *t, const float *r)
 {
-    float *p;
-    float *q;
+    struct page *a;
 
     if (scm_scan_catalog(s))
     {
-        report_init((int) scm_get_length(s));
+        long long l = scm_get_length(s);
 
-        if ((p = scm_alloc_buffer(s)) && (q = scm_alloc_buffer(t)))
+        report_init((int) l);
+
+        if ((a = (struct page *) malloc((size_t) l * sizeof (struct page))))
         {
-            long long b = 0;
+            long long c = 0;
+
+            for (long long x = 0; x < 6; ++x)
+                c = divide(s, x, 0, 0, 1, a, c);
+
+            // Allocate readers and image buffers.
+
+            const size_t z = 3 * (size_t) (scm_get_n(t) + 2)
+                               * (size_t) (scm_get_n(t) + 2) * sizeof (float);
+
+            scm   *R[K];
+            float *p[K];
+            float *q[K];
+            int    k;
+            int    j;
+
+            for (k = 0; k < K; ++k)
+            {
+                R[k] = NULL;
+                p[k] = NULL;
+                q[k] = NULL;
+            }
+            for (k = 0; k < K; ++k)
+                if ((R[k] = scm_reader(s))       == NULL ||
+                    (p[k] = scm_alloc_buffer(s)) == NULL ||
+                    (q[k] = scm_alloc_buffer(t)) == NULL)
+                    break;
+                else
+                    memset(q[k], 0, z);
+
+            if (k == K)
+            {
+                long long b = 0;
 
-            memset(q, 0, 3 * (size_t) (scm_get_n(t) + 2) *
-                             (size_t) (scm_get_n(t) + 2) * sizeof (float));
+                for (long long i = 0; i < c; i += K)
+                {
+                    bool ok[K];
 
-            b = divide(s, 0, t, b, 0, 0, 1, r, p, q);
-            b = divide(s, 1, t, b, 0, 0, 1, r, p, q);
-            b = divide(s, 2, t, b, 0, 0, 1, r, p, q);
-            b = divide(s, 3, t, b, 0, 0, 1, r, p, q);
-            b = divide(s, 4, t, b, 0, 0, 1, r, p, q);
-            b = divide(s, 5, t, b, 0, 0, 1, r, p, q);
+                    j = (int) min(c - i, K);
 
-            free(q);
-            free(p);
+                    #pragma omp parallel for
+                    for (k = 0; k < j; ++k)
+                        ok[k] = compute(R[k], a + i + k, r, p[k], q[k]);
+
+                    for (k = 0; k < j; ++k)
+                        if (ok[k])
+                        {
+                            b = scm_append(t, b, a[i + k].x, q[k]);
+                            report_step();
+                        }
+                }
+            }
+
+            for (k = 0; k < K; ++k)
+            {
+                scm_close(R[k]);
+                free(q[k]);
+                free(p[k]);
+            }
+            free(a);
         }
     }
 }
 
 //------------------------------------------------------------------------------
 
-int normal(int argc, char **argv, const char *o, const float *R)
+int normal(int argc, char **argv, const char *o, const float *R, const int *Z)
 {
     if (argc > 0)
     {
@@ -196,11 +264,19 @@ int normal(int argc, char **argv, const char *o, const float *R)
         scm *s;
         scm *t;
 
-        if ((s = scm_ifile(argv[0])))
+        if ((s = scm_ifile_io(argv[0], SCM_IO_MMAP)))
         {
-            if ((t = scm_ofile(out, scm_get_n(s), 3, 8, 0)))
+            if ((t = scm_ofile_io(out, scm_get_n(s), 3, 8, 0, scm_get_r(s),
+                                                       SCM_IO_PREAD)))
             {
-                process(s, t, R);
+                if (scm_set_tile(t, scm_get_t(s)) &&
+                    scm_set_compression(t, Z[0] ? Z[0] : scm_get_z(s),
+                                           Z[0] ? Z[1] : scm_get_l(s)))
+                {
+                    scm_set_constant(t, Z[2]);
+                    scm_write_behind(t, 4);
+                    process(s, t, R);
+                }
                 scm_close(t);
             }
             scm_close(s);
@@ -15,20 +15,22 @@
 
 //------------------------------------------------------------------------------
 
-int convert(int, char **, const char *, int, int, int, int, int,
+int convert(int, char **, const char *, int, int, int, int, int, int, int,
+           const int *,
            const float *, const double *, const double *, const double *);
 
-int combine(int, char **, const char *, const char *);
-int normal (int, char **, const char *, const float *);
-int mipmap (int, char **, const char *, const char *, int);
-int border (int, char **, const char *);
-int prune  (int, char **, const char *);
+int combine(int, char **, const char *, const char *, const int *);
+int normal (int, char **, const char *, const float *, const int *);
+int mipmap (int, char **, const char *, const char *, int, const int *);
+int border (int, char **, const char *, int, const int *);
+int prune  (int, char **, const char *, const int *);
 int finish (int, char **, const char *, int);
 int polish (int, char **);
 
 int sample (int, char **, const float *, int);
 int extrema(int, char **);
 int query  (int, char **);
+int bench  (int, char **, const char *, const char *, int, const int *);
 
 int rectify(int, char **, const char *, int,
            const float *, const double *, const double *, const double *);
@@ -22,28 +22,22 @@
 
 //------------------------------------------------------------------------------
 
-static const float *pixel(const float *p, int n, int c, int i, int j)
+// Pages are examined in their native type, with e bytes per pixel, as pixels
+// need only be compared for equality.
+
+static const uint8_t *pixel(const uint8_t *p, int n, int e, int i, int j)
 {
-    return p + c * (i * n + j);
+    return p + e * (i * n + j);
 }
 
-static bool necessary(const float *p, int n, int c)
+static bool necessary(const uint8_t *p, int n, int e)
 {
-    const float *a = pixel(p, n, c, 1, 1);
+    const uint8_t *a = pixel(p, n, e, 1, 1);
 
     for     (int i = 0; i < n; i++)
         for (int j = 0; j < n; j++)
-        {
-            const float *b = pixel(p, n, c, i, j);
-
-            switch (c)
-            {
-                case 4: if (a[3] != b[3]) return true;
-                case 3: if (a[2] != b[2]) return true;
-                case 2: if (a[1] != b[1]) return true;
-                case 1: if (a[0] != b[0]) return true;
-            }
-        }
+            if (memcmp(a, pixel(p, n, e, i, j), (size_t) e))
+                return true;
 
     return false;
 }
@@ -64,27 +58,27 @@ static void forget(scm *s, long long i)
 static void process(scm *s, scm *t)
 {
     const int n = scm_get_n(s);
-    const int c = scm_get_c(s);
+    const int e = scm_get_c(s) * scm_get_b(s) / 8;
 
     long long b = 0;
-    float    *p;
+    uint8_t  *p;
 
     if (scm_scan_catalog(s))
     {
         report_init((int) scm_get_length(s));
 
-        if ((p = scm_alloc_buffer(s)))
+        if ((p = (uint8_t *) scm_alloc_raw_buffer(s)))
         {
             for (long long i = 0; i < scm_get_length(s); ++i)
             {
                 const long long o = scm_get_offset(s, i);
                 const long long x = scm_get_index (s, i);
 
-                if (o && scm_read_page(s, o, p))
+                if (o && scm_read_page_raw(s, o, p))
                 {
-                    if (scm_page_level(x) == 0 || necessary(p, n + 2, c))
+                    if (scm_page_level(x) == 0 || necessary(p, n + 2, e))
                     {
-                        b = scm_append(t, b, x, p);
+                        b = scm_append_raw(t, b, x, p);
                     }
                     else
                     {
@@ -100,7 +94,7 @@ static void process(scm *s, scm *t)
 
 //------------------------------------------------------------------------------
 
-int prune(int argc, char **argv, const char *o)
+int prune(int argc, char **argv, const char *o, const int *Z)
 {
     if (argc > 0)
     {
@@ -115,10 +109,17 @@ int prune(int argc, char **argv, const char *o)
             int c = scm_get_c(s);
             int b = scm_get_b(s);
             int g = scm_get_g(s);
+            int r = scm_get_r(s);
 
-            if ((t = scm_ofile(out, n, c, b, g)))
+            if ((t = scm_ofile_io(out, n, c, b, g, r, SCM_IO_STDIO)))
             {
-                process(s, t);
+                if (scm_set_tile(t, scm_get_t(s)) &&
+                    scm_set_compression(t, Z[0] ? Z[0] : scm_get_z(s),
+                                           Z[0] ? Z[1] : scm_get_l(s)))
+                {
+                    scm_set_constant(t, Z[2]);
+                    process(s, t);
+                }
                 scm_close(t);
             }
             scm_close(s);
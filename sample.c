@@ -22,7 +22,7 @@
 //------------------------------------------------------------------------------
 
 static bool traverse(scm *s, double a, double b, long long x, int d,
-                     long long *h, float *p, float *q)
+                     float *p, float *q)
 {
     long long i;
 
@@ -46,12 +46,12 @@ static bool traverse(scm *s, double a, double b, long long x, int d,
             {
                 if (a < 0.5)
                 {
-                    if (traverse(s, a0, b0, x0, d - 1, h, p, q))
+                    if (traverse(s, a0, b0, x0, d - 1, p, q))
                         return true;
                 }
                 else
                 {
-                    if (traverse(s, a1, b0, x1, d - 1, h, p, q))
+                    if (traverse(s, a1, b0, x1, d - 1, p, q))
                         return true;
                 }
             }
@@ -59,35 +59,28 @@ static bool traverse(scm *s, double a, double b, long long x, int d,
             {
                 if (a < 0.5)
                 {
-                    if (traverse(s, a0, b1, x2, d - 1, h, p, q))
+                    if (traverse(s, a0, b1, x2, d - 1, p, q))
                         return true;
                 }
                 else
                 {
-                    if (traverse(s, a1, b1, x3, d - 1, h, p, q))
+                    if (traverse(s, a1, b1, x3, d - 1, p, q))
                         return true;
                 }
             }
         }
 
-        // This must be the best page. Load it, if not already loaded.
+        // This must be the best page. Load the samples about the given point
+        // and interpolate them.
 
-        if (h[0] != i)
-        {
-            if (scm_read_page(s, scm_get_offset(s, i), p))
-                h[0] = i;
-        }
+        const int c = scm_get_c(s);
+        const int n = scm_get_n(s);
 
-        // If loaded, sample this page at the given point.
+        int j1 = (int) floor(a * n) + 1, j2 = j1 + 1;
+        int i1 = (int) floor(b * n) + 1, i2 = i1 + 1;
 
-        if (h[0] == i)
+        if (scm_read_region(s, scm_get_offset(s, i), j1, i1, j2 + 1, i2 + 1, p))
         {
-            const int c = scm_get_c(s);
-            const int n = scm_get_n(s);
-
-            int j1 = (int) floor(a * n) + 1, j2 = j1 + 1;
-            int i1 = (int) floor(b * n) + 1, i2 = i1 + 1;
-
             float jj = (float) (a * n - floor(a * n));
             float ii = (float) (b * n - floor(b * n));
 
@@ -104,7 +97,7 @@ static bool traverse(scm *s, double a, double b, long long x, int d,
 }
 
 static bool locate(scm *s, double lat, double lon, int d,
-                   long long *h, float *p, float *q)
+                   float *p, float *q)
 {
     int i = 4;
 
@@ -138,7 +131,7 @@ static bool locate(scm *s, double lat, double lon, int d,
     double A = (-a + M_PI / 4.0) / (M_PI / 2.0);
     double B = (-b + M_PI / 4.0) / (M_PI / 2.0);
 
-    return traverse(s, A, B, i, d, h, p, q);
+    return traverse(s, A, B, i, d, p, q);
 }
 
 static void process(scm *s, const float *R, int d)
@@ -147,8 +140,6 @@ static void process(scm *s, const float *R, int d)
 
     if ((p = scm_alloc_buffer(s)))
     {
-        long long h = -1;
-
         double lon;
         double lat;
 
@@ -161,7 +152,7 @@ static void process(scm *s, const float *R, int d)
 
             float q[4];
 
-            if (locate(s, lat, lon, d, &h, p, q))
+            if (locate(s, lat, lon, d, p, q))
             {
                 for (int i = 0; i < c; i++)
                     printf("%f ", q[i] * (R[1] - R[0]) + R[0]);
@@ -180,7 +171,6 @@ static void image(scm *s, const float *R, int d)
 
     if ((p = scm_alloc_buffer(s)))
     {
-        int h = -1;
         int i;
         int j;
 
@@ -190,7 +180,7 @@ static void image(scm *s, const float *R, int d)
                 double lon = ((double) j + 0.5) * M_PI / 180.0;
                 double lat = ((double) i - 0.5) * M_PI / 180.0;
 
-                locate(s, lat, lon, d, &h, p, q);
+                locate(s, lat, lon, d, p, q);
 
                 unsigned char c = (unsigned char) (q[0] * 255);
 
@@ -209,7 +199,7 @@ int sample(int argc, char **argv, const float *R, int d)
     {
         scm *s;
 
-        if ((s = scm_ifile(argv[0])))
+        if ((s = scm_ifile_io(argv[0], SCM_IO_MMAP)))
         {
             if (scm_scan_catalog(s))
             {
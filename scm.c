@@ -25,8 +25,176 @@
 #include "err.h"
 #include "util.h"
 
+#if defined(__GNUC__)
+#define prefetch(p) __builtin_prefetch(p)
+#elif defined(_MSC_VER) && (defined(_M_X64) || defined(_M_IX86))
+#include <xmmintrin.h>
+#define prefetch(p) _mm_prefetch((const char *) (p), _MM_HINT_T0)
+#else
+#define prefetch(p)
+#endif
+
 //------------------------------------------------------------------------------
 
+// Presence bitmaps give constant-time search of a sorted array of page indices.
+// Pages are numbered breadth-first, so the shallowest levels, which are also
+// the densest, hold the lowest indices, and one bit per possible page covers
+// them compactly. Each word of the bitmap notes the array position of the first
+// page it covers, so a search is a bit test and a population count. Pages too
+// deep to be covered are found by searching the array. The bitmap extends to
+// at most SCM_RANK_DEPTH levels, and at most SCM_RANK_BITS bits per entry.
+
+#define SCM_RANK_DEPTH 12
+#define SCM_RANK_BITS  64
+
+struct scm_rank
+{
+    long long  m;               // Count of page indices covered
+    uint64_t  *b;               // Presence bits of pages 0 through m - 1
+    long long *r;               // Array position of the first page of each word
+};
+
+// Count the set bits of v.
+
+static inline int popcount(uint64_t v)
+{
+#if defined(__GNUC__)
+    return __builtin_popcountll(v);
+#else
+    v = v - ((v >> 1) & 0x5555555555555555ULL);
+    v = (v & 0x3333333333333333ULL) + ((v >> 2) & 0x3333333333333333ULL);
+    v = (v + (v >> 4)) & 0x0F0F0F0F0F0F0F0FULL;
+    return (int) ((v * 0x0101010101010101ULL) >> 56);
+#endif
+}
+
+// Release a presence bitmap.
+
+static void rkfree(struct scm_rank *k)
+{
+    if (k)
+    {
+        free(k->b);
+        free(k->r);
+        free(k);
+    }
+}
+
+// Build the presence bitmap of the page indices in sorted array v of length c.
+// A position can't be counted from the bits if indices repeat, so return NULL
+// if any covered index does, or on failure.
+
+static struct scm_rank *rkinit(long long c, const long long *v)
+{
+    struct scm_rank *k = NULL;
+
+    long long d = 0;
+    long long i = 0;
+    long long j;
+
+    while (d < SCM_RANK_DEPTH && scm_page_count(d + 1) <= SCM_RANK_BITS * c)
+        d++;
+
+    const long long m = scm_page_count(d);
+    const long long w = (m + 63) / 64;
+
+    if ((k    = (struct scm_rank *) calloc(1, sizeof (struct scm_rank))) &&
+        (k->b = (uint64_t  *) calloc((size_t) w, sizeof (uint64_t)))     &&
+        (k->r = (long long *) malloc((size_t) w * sizeof (long long))))
+    {
+        k->m = m;
+
+        while (i < c && v[i] < 0)
+            i++;
+
+        for (j = 0; j < w; ++j)
+        {
+            const long long e = min(64 * (j + 1), m);
+
+            for (k->r[j] = i; i < c && v[i] < e; ++i)
+            {
+                if (i > 0 && v[i] == v[i - 1])
+                {
+                    rkfree(k);
+                    return NULL;
+                }
+                k->b[j] |= 1ULL << (v[i] & 63);
+            }
+        }
+        return k;
+    }
+    rkfree(k);
+    return NULL;
+}
+
+//------------------------------------------------------------------------------
+
+// Map the array of c long longs at offset o of SCM s, or failing that, read it
+// into a newly allocated buffer. Note any mapping in m and l. Return a pointer
+// to the array, or NULL on failure.
+
+static long long *scm_load_array(scm *s, long long c, long long o,
+                                 void **m, size_t *l)
+{
+    const size_t n = (size_t) c * sizeof (long long);
+
+    long long *v;
+
+    *m = NULL;
+    *l = 0;
+
+    if (c > 0)
+    {
+        if (o % (long long) sizeof (long long) == 0)
+            if ((v = (long long *) scm_map(s, n, o, m, l)))
+                return v;
+
+        if ((v = (long long *) malloc(n)))
+        {
+            if (scm_read(s, v, n, o))
+                return v;
+
+            free(v);
+        }
+    }
+    return NULL;
+}
+
+// Release an array given by scm_load_array.
+
+static void scm_free_array(long long *v, void *m, size_t l)
+{
+    if (m)
+        scm_unmap(m, l);
+    else
+        free(v);
+}
+
+// Release the catalog of SCM s.
+
+static void scm_free_catalog(scm *s)
+{
+    scm_free_array(s->xv, s->xm, s->xl);
+    scm_free_array(s->ov, s->om, s->ol);
+
+    free(s->ev);
+    free(s->ei);
+    rkfree(s->rk);
+
+    s->xc = 0;
+    s->xv = NULL;
+    s->xm = NULL;
+    s->xl = 0;
+    s->oc = 0;
+    s->ov = NULL;
+    s->om = NULL;
+    s->ol = 0;
+    s->ev = NULL;
+    s->ei = NULL;
+    s->en = 0;
+    s->rk = NULL;
+}
+
 // Release all resources associated with SCM s. This function may be used to
 // clean up after an error during initialization, and does not assume that the
 // structure is fully populated.
@@ -35,18 +203,50 @@ void scm_close(scm *s)
 {
     if (s)
     {
-        if (s->fp)
-            fclose(s->fp);
-        scm_free(s);
-        free(s->name);
+        scm_read_pool_init (s, 0);
+
+        if (s->base)
+            scm_unshadow(s);
+        else
+        {
+            scm_write_queue_init(s, 0);
+            scm_cache_init      (s, 0);
+            scm_free_catalog(s);
+            scm_fclose(s);
+            scm_free(s);
+            free(s->name);
+        }
         free(s);
     }
 }
 
+// Create a reader of SCM s. A reader shares the file and catalog of s, but has
+// its own scratch buffers and file position, so that each of several threads
+// may read pages of s concurrently using its own reader. The catalog of s must
+// not change while readers exist. Release a reader using scm_close before s.
+
+scm *scm_reader(scm *s)
+{
+    scm *t = NULL;
+
+    assert(s);
+
+    if ((t = (scm *) calloc(sizeof (scm), 1)))
+    {
+        if (scm_shadow(t, s))
+        {
+            return t;
+        }
+        free(t);
+    }
+    return NULL;
+}
+
 // Open an SCM TIFF input file. Validate the header. Read and validate the first
 // IFD. Initialize and return an SCM structure using the first IFD's parameters.
+// Perform all I/O using back end io.
 
-scm *scm_ifile(const char *name)
+scm *scm_ifile_io(const char *name, int io)
 {
     scm *s = NULL;
 
@@ -54,7 +254,10 @@ scm *scm_ifile(const char *name)
 
     if ((s = (scm *) calloc(sizeof (scm), 1)))
     {
-        if ((s->fp = fopen(name, "r+b")))
+        s->io = io;
+        s->fd = -1;
+
+        if (scm_fopen(s, name, "r+b"))
         {
             if (scm_read_preamble(s))
             {
@@ -72,9 +275,11 @@ scm *scm_ifile(const char *name)
 }
 
 // Open an SCM TIFF output file. Initialize and return an SCM structure with the
-// given parameters. Write the TIFF header and SCM TIFF preface.
+// given parameters, storing r rows per strip. Write the TIFF header and SCM TIFF
+// preface. Perform all I/O using back end io. Half-precision floating point (g
+// of 2) is defined only for 16-bit samples.
 
-scm *scm_ofile(const char *name, int n, int c, int b, int g)
+scm *scm_ofile_io(const char *name, int n, int c, int b, int g, int r, int io)
 {
     scm *s = NULL;
 
@@ -83,15 +288,30 @@ scm *scm_ofile(const char *name, int n, int c, int b, int g)
     assert(c > 0);
     assert(b > 0);
 
+    if (r <= 0)
+    {
+        apperr("%s: Rows per strip %d is not positive", name, r);
+        return NULL;
+    }
+    if (g == 2 && b != 16)
+    {
+        apperr("%s: Half float requires 16 bits per sample, not %d", name, b);
+        return NULL;
+    }
+
     if ((s = (scm *) calloc(sizeof (scm), 1)))
     {
         s->n =  n;
         s->c =  c;
         s->b =  b;
         s->g =  g;
-        s->r = 16;
+        s->r =  min(r, n + 2);
+        s->z =  SCM_COMPRESS_DEFLATE;
+        s->l =  SCM_DEFAULT_LEVEL;
+        s->io = io;
+        s->fd = -1;
 
-        if ((s->fp = fopen(name, "w+b")))
+        if (scm_fopen(s, name, "w+b"))
         {
             if (scm_write_preamble(s))
             {
@@ -111,6 +331,126 @@ scm *scm_ofile(const char *name, int n, int c, int b, int g)
     return NULL;
 }
 
+// Open SCM TIFF input and output files using buffered stdio and the default
+// rows per strip.
+
+scm *scm_ifile(const char *name)
+{
+    return scm_ifile_io(name, SCM_IO_STDIO);
+}
+
+scm *scm_ofile(const char *name, int n, int c, int b, int g)
+{
+    return scm_ofile_io(name, n, c, b, g, SCM_DEFAULT_ROWS, SCM_IO_STDIO);
+}
+
+// Store the pages of output SCM s as tiles of t by t samples, or as strips if t
+// is zero. Tiles allow a small region of a page to be read without decoding
+// all of it. TIFF requires that t be a multiple of 16. This must be called
+// before any page is appended.
+
+bool scm_set_tile(scm *s, int t)
+{
+    assert(s);
+    assert(t >= 0);
+
+    if (t % 16)
+    {
+        apperr("%s: Tile size %d is not a multiple of 16", s->name, t);
+        return false;
+    }
+
+    scm_free(s);
+
+    s->t = t;
+
+    if (scm_strips(s) > UINT16_MAX)
+    {
+        apperr("%s: Tile size %d gives too many tiles", s->name, t);
+        s->t = 0;
+        scm_alloc(s);
+        return false;
+    }
+    return scm_alloc(s);
+}
+
+// Compress new pages of SCM s using scheme z at level l, or the default level
+// of that scheme if l is negative. Pages already written are unaffected, and
+// pages of differing schemes may be mixed within one file. At the adaptive
+// level, each page is stored, or compressed at the fast or default level,
+// according to the ratio achieved on its first strips.
+
+bool scm_set_compression(scm *s, int z, int l)
+{
+    assert(s);
+
+    if (!scm_codec(z))
+    {
+        apperr("%s: Compression scheme %d is not supported", s->name, z);
+        return false;
+    }
+
+    s->z = z;
+    s->l = l;
+
+    return true;
+}
+
+// Enable or disable storing each uniform new page of SCM s as its one pixel.
+// This is compact, but LibTIFF can't read such pages.
+
+void scm_set_constant(scm *s, bool u)
+{
+    assert(s);
+    s->u = u;
+}
+
+// Parse a compression option of the form codec[:level], where codec is one of
+// none, deflate, zstd, lz4, or auto, and level may be auto. Auto alone selects
+// adaptive deflate. Store the scheme and level in z and l.
+
+bool scm_parse_compression(const char *str, int *z, int *l)
+{
+    static const struct { const char *name; int z; int l; } codecs[] = {
+        { "none",    SCM_COMPRESS_NONE,    SCM_DEFAULT_LEVEL  },
+        { "store",   SCM_COMPRESS_NONE,    SCM_DEFAULT_LEVEL  },
+        { "deflate", SCM_COMPRESS_DEFLATE, SCM_DEFAULT_LEVEL  },
+        { "zlib",    SCM_COMPRESS_DEFLATE, SCM_DEFAULT_LEVEL  },
+        { "zstd",    SCM_COMPRESS_ZSTD,    SCM_DEFAULT_LEVEL  },
+        { "lz4",     SCM_COMPRESS_LZ4,     SCM_DEFAULT_LEVEL  },
+        { "auto",    SCM_COMPRESS_DEFLATE, SCM_ADAPTIVE_LEVEL },
+    };
+
+    const char *c = strchr(str, ':');
+    size_t      n = c ? (size_t) (c - str) : strlen(str);
+
+    for (size_t i = 0; i < sizeof (codecs) / sizeof (codecs[0]); i++)
+        if (strlen(codecs[i].name) == n && strncmp(codecs[i].name, str, n) == 0)
+        {
+            if (!scm_codec(codecs[i].z))
+            {
+                apperr("Compression '%s' is not supported by this build", str);
+                return false;
+            }
+
+            *z = codecs[i].z;
+            *l = codecs[i].l;
+
+            if (c && strcmp(c + 1, "auto") == 0)
+                *l = SCM_ADAPTIVE_LEVEL;
+
+            else if (c && sscanf(c + 1, "%d", l) != 1)
+            {
+                apperr("Bad compression level '%s'", c + 1);
+                return false;
+            }
+            return true;
+        }
+
+    apperr("Unknown compression '%s'", str);
+    return false;
+}
+
 //------------------------------------------------------------------------------
 
 // Allocate and return a buffer with the proper size to fit one page of data,
@@ -118,10 +458,15 @@ scm *scm_ofile(const char *name, int n, int c, int b, int g)
 
 float *scm_alloc_buffer(scm *s)
 {
-    size_t o = (size_t) s->n + 2;
-    size_t c = (size_t) s->c;
+    return (float *) malloc(scm_page_size(s, false));
+}
 
-    return (float *) malloc(o * o * c * sizeof (float));
+// Allocate and return a buffer to fit one page of samples of the native type
+// of SCM s, for use with the raw read and append functions.
+
+void *scm_alloc_raw_buffer(scm *s)
+{
+    return malloc(scm_page_size(s, true));
 }
 
 // Query the parameters of SCM s.
@@ -150,6 +495,30 @@ int scm_get_g(scm *s)
     return s->g;
 }
 
+int scm_get_r(scm *s)
+{
+    assert(s);
+    return s->r;
+}
+
+int scm_get_t(scm *s)
+{
+    assert(s);
+    return s->t;
+}
+
+int scm_get_z(scm *s)
+{
+    assert(s);
+    return s->z;
+}
+
+int scm_get_l(scm *s)
+{
+    assert(s);
+    return s->l;
+}
+
 //------------------------------------------------------------------------------
 
 void scm_get_sample_corners(int f, long i, long j, long n, double *v)
@@ -188,72 +557,100 @@ static long long llsearch(long long x, long long c, const long long *v)
     return p ? (long long *) p - v : -1;
 }
 
-// Page x is a leaf if none of its children appear in the array.
+// Return the position of page index x in the array v of length c with presence
+// bitmap k, or -1 if it is absent. k may be NULL.
 
-static bool isleaf(long long x, long long c, const long long *v)
+static long long rksearch(const struct scm_rank *k, long long x,
+                                long long c, const long long *v)
 {
-    if      (llsearch(scm_page_child(x, 0), c, v) >= 0) return false;
-    else if (llsearch(scm_page_child(x, 1), c, v) >= 0) return false;
-    else if (llsearch(scm_page_child(x, 2), c, v) >= 0) return false;
-    else if (llsearch(scm_page_child(x, 3), c, v) >= 0) return false;
+    if (k && 0 <= x && x < k->m)
+    {
+        const uint64_t b = k->b[x >> 6];
+        const uint64_t u = 1ULL << (x & 63);
 
-    else return true;
+        return (b & u) ? k->r[x >> 6] + popcount(b & (u - 1)) : -1;
+    }
+    return llsearch(x, c, v);
 }
 
-// Allocate and initialize a sorted array with the indices of all present pages.
+// Page x is a leaf if none of its children appear in the array.
 
-static long long scm_scan_indices(scm *s, long long **v)
+static bool isleaf(const struct scm_rank *rk, long long x,
+                         long long c, const long long *v)
 {
-    ifd d;
-
-    long long n = 0;
-    long long c = 0;
-    long long o;
+    if      (rksearch(rk, scm_page_child(x, 0), c, v) >= 0) return false;
+    else if (rksearch(rk, scm_page_child(x, 1), c, v) >= 0) return false;
+    else if (rksearch(rk, scm_page_child(x, 2), c, v) >= 0) return false;
+    else if (rksearch(rk, scm_page_child(x, 3), c, v) >= 0) return false;
 
-    // Scan the file to count the pages.
-
-    for (o = scm_rewind(s); scm_read_ifd(s, &d, o); o = (long long) d.next)
-        n++;
-
-    // Allocate storage for all indices.
-
-    if ((v[0] = (long long *) calloc((size_t) n, sizeof (long long))) == NULL)
-        return 0;
+    else return true;
+}
 
-    // Scan the file to read the indices.
+// Allocate and initialize arrays with the indices and offsets of all present
+// pages in index-sorted order, scanning the file once. The scan yields index-
+// offset pairs, which sort together by index.
 
-    for (o = scm_rewind(s); scm_read_ifd(s, &d, o); o = (long long) d.next)
-        v[0][c++] = (long long) d.page_number.offset;
+static long long scm_scan_pages(scm *s, long long **xv, long long **ov)
+{
+    long long *v = NULL;
+    long long  c = 0;
+    long long  i;
 
-    // Sort the array.
+    if ((c = scm_scan_list(s, scm_rewind(s), &v)))
+    {
+        qsort(v, (size_t) c, 2 * sizeof (long long), llcompare);
 
-    qsort(v[0], (size_t) c, sizeof (long long), llcompare);
+        xv[0] = (long long *) malloc((size_t) c * sizeof (long long));
+        ov[0] = (long long *) malloc((size_t) c * sizeof (long long));
 
+        if (xv[0] && ov[0])
+        {
+            for (i = 0; i < c; ++i)
+            {
+                xv[0][i] = v[2 * i + 0];
+                ov[0][i] = v[2 * i + 1];
+            }
+        }
+        else
+        {
+            free(xv[0]);
+            free(ov[0]);
+            xv[0] = NULL;
+            ov[0] = NULL;
+            c     = 0;
+        }
+    }
+    free(v);
     return c;
 }
 
-// Allocate and initialize an array giving the file offsets of all present pages
-// in index-sorted order. O(n log n).
+// Allocate and initialize an array giving the file offsets of the pages with
+// the xc indices in xv, or zero for those absent from the scanned catalog of
+// yc indices yv and offsets yo.
 
-static long long scm_scan_offsets(scm *s, long long **v,
-                      long long xc, const long long *xv)
+static long long scm_scan_offsets(long long **v,
+                                  long long xc, const long long *xv,
+                                  long long yc, const long long *yv,
+                                                const long long *yo)
 {
-    ifd d;
+    struct scm_rank *rk = rkinit(yc, yv);
 
-    long long o;
     long long i;
+    long long j;
 
     // Allocate storage for all offsets.
 
-    if ((v[0] = (long long *) calloc((size_t) xc, sizeof (long long))) == NULL)
-        return 0;
-
-    // Scan the file to read the offsets.
+    if ((v[0] = (long long *) calloc((size_t) xc, sizeof (long long))))
+    {
+        // Look up the offset of each page.
 
-    for (o = scm_rewind(s); scm_read_ifd(s, &d, o); o = (long long) d.next)
-        if ((i = llsearch((long long) d.page_number.offset, xc, xv)) >= 0)
-            v[0][i] = o;
+        for (i = 0; i < xc; ++i)
+            if ((j = rksearch(rk, xv[i], yc, yv)) >= 0)
+                v[0][i] = yo[j];
+    }
+    else xc = 0;
 
+    rkfree(rk);
     return xc;
 }
 
@@ -282,18 +679,23 @@ static long long scm_grow_leaves(scm *s, long long **v,
 {
     // Count the number of pages in the extended catalog.
 
+    struct scm_rank *rk = d ? rkinit(xc, xv) : NULL;
+
     long long m = xc;
     long long c = xc;
     long long i;
 
     for (i = 0; d && i < xc; ++i)
-        if (isleaf(xv[i], xc, xv))
+        if (isleaf(rk, xv[i], xc, xv))
             m += (1 - (1 << (2 * d + 2))) / (-d);
 
     // Allocate storage for the extended catalog.
 
     if ((v[0] = (long long *) malloc((size_t) m * sizeof (long long))) == NULL)
+    {
+        rkfree(rk);
         return 0;
+    }
 
     // Copy the basic catalog.
 
@@ -302,7 +704,7 @@ static long long scm_grow_leaves(scm *s, long long **v,
     // Extend the catalog.
 
     for (i = 0; d && i < xc; ++i)
-        if (isleaf(xv[i], xc, xv))
+        if (isleaf(rk, xv[i], xc, xv))
         {
             c = scm_grow_leaf(scm_page_child(xv[i], 0), v, c, d - 1);
             c = scm_grow_leaf(scm_page_child(xv[i], 1), v, c, d - 1);
@@ -310,6 +712,8 @@ static long long scm_grow_leaves(scm *s, long long **v,
             c = scm_grow_leaf(scm_page_child(xv[i], 3), v, c, d - 1);
         }
 
+    rkfree(rk);
+
     // Sort the extended catalog.
 
     qsort(v[0], (size_t) c, sizeof (long long), llcompare);
@@ -320,16 +724,16 @@ static long long scm_grow_leaves(scm *s, long long **v,
 // Compute the extrema of an internal node. This is trivially defined in terms
 // of the extrema of its children.
 
-static void scm_bound_node(scm *s, long long x,
+static void scm_bound_node(scm *s, long long x, const struct scm_rank *rk,
                                    long long c, const long long *v, float *av,
                                                                     float *zv)
 {
-    long long i  = llsearch(x, c, v);
+    long long i  = rksearch(rk, x, c, v);
 
-    long long i0 = llsearch(scm_page_child(x, 0), c, v);
-    long long i1 = llsearch(scm_page_child(x, 1), c, v);
-    long long i2 = llsearch(scm_page_child(x, 2), c, v);
-    long long i3 = llsearch(scm_page_child(x, 3), c, v);
+    long long i0 = rksearch(rk, scm_page_child(x, 0), c, v);
+    long long i1 = rksearch(rk, scm_page_child(x, 1), c, v);
+    long long i2 = rksearch(rk, scm_page_child(x, 2), c, v);
+    long long i3 = rksearch(rk, scm_page_child(x, 3), c, v);
 
     for (int k = 0; k < s->c; ++k)
     {
@@ -369,6 +773,7 @@ static void scm_bound_node(scm *s, long long x,
 // each new leaf by scanning the pixel buffer pp.
 
 static void scm_bound_leaf(scm *s, long long x,  const float     *pp,
+                                   const struct scm_rank         *rk,
                                    long long yc, const long long *yv,
                                    float *av,
                                    float *zv,
@@ -388,17 +793,17 @@ static void scm_bound_leaf(scm *s, long long x,  const float     *pp,
         int h = (l + r) / 2;
         int v = (b + t) / 2;
 
-        scm_bound_leaf(s, x0, pp, yc, yv, av, zv, l, h, t, v, d - 1);
-        scm_bound_leaf(s, x1, pp, yc, yv, av, zv, h, r, t, v, d - 1);
-        scm_bound_leaf(s, x2, pp, yc, yv, av, zv, l, h, v, b, d - 1);
-        scm_bound_leaf(s, x3, pp, yc, yv, av, zv, h, r, v, b, d - 1);
+        scm_bound_leaf(s, x0, pp, rk, yc, yv, av, zv, l, h, t, v, d - 1);
+        scm_bound_leaf(s, x1, pp, rk, yc, yv, av, zv, h, r, t, v, d - 1);
+        scm_bound_leaf(s, x2, pp, rk, yc, yv, av, zv, l, h, v, b, d - 1);
+        scm_bound_leaf(s, x3, pp, rk, yc, yv, av, zv, h, r, v, b, d - 1);
 
-        scm_bound_node(s, x, yc, yv, av, zv);
+        scm_bound_node(s, x, rk, yc, yv, av, zv);
     }
 
     // Sample the leaf subdivision and note the extrema.
 
-    else if ((i = llsearch(x, yc, yv)) >= 0)
+    else if ((i = rksearch(rk, x, yc, yv)) >= 0)
     {
         for (int k = 0; k < s->c; ++k)
         {
@@ -419,20 +824,21 @@ static void scm_bound_leaf(scm *s, long long x,  const float     *pp,
     }
 }
 
-// Compute the min and max values of all pages. ov gives the file offset of all
-// real pages and xv gives the page index of all real pages. yv gives the page
-// index of all pages, real or virtual, and d gives the subdivision depth of
-// virtual pages. Allocate and initialize minv and maxv with the min and max
-// values of all real and virtual pages.
+// Compute the min and max values of all pages. yv gives the page index of all
+// yc pages, real or virtual, and ov gives the file offset of each, or zero for
+// a virtual page. d gives the subdivision depth of virtual pages. Allocate and
+// initialize minv and maxv with the min and max values of all pages.
 
 static bool scm_bound(scm *s, long long yc, const long long *yv,
-                              long long oc, const long long *ov,
+                                          const long long *ov,
                                                     void **minv,
                                                     void **maxv, int d)
 {
     const size_t sz = tifsizeof(scm_type(s));
     const size_t yz = (size_t) yc * (size_t) s->c;
 
+    struct scm_rank *rk = rkinit(yc, yv);
+
     float *pp = NULL;
     float *av = NULL;
     float *zv = NULL;
@@ -450,10 +856,14 @@ static bool scm_bound(scm *s, long long yc, const long long *yv,
             {
                 if (ov[i])
                 {
-                    long long j0 = llsearch(scm_page_child(yv[i], 0), yc, yv);
-                    long long j1 = llsearch(scm_page_child(yv[i], 1), yc, yv);
-                    long long j2 = llsearch(scm_page_child(yv[i], 2), yc, yv);
-                    long long j3 = llsearch(scm_page_child(yv[i], 3), yc, yv);
+                    long long j0 = rksearch(rk, scm_page_child(yv[i], 0),
+                                            yc, yv);
+                    long long j1 = rksearch(rk, scm_page_child(yv[i], 1),
+                                            yc, yv);
+                    long long j2 = rksearch(rk, scm_page_child(yv[i], 2),
+                                            yc, yv);
+                    long long j3 = rksearch(rk, scm_page_child(yv[i], 3),
+                                            yc, yv);
 
                     if (j0 >= 0 && ov[j0] == 0 &&
                         j1 >= 0 && ov[j1] == 0 &&
@@ -461,10 +871,10 @@ static bool scm_bound(scm *s, long long yc, const long long *yv,
                         j3 >= 0 && ov[j3] == 0)
                     {
                         if (scm_read_page (s, ov[i], pp))
-                            scm_bound_leaf(s, yv[i], pp,
+                            scm_bound_leaf(s, yv[i], pp, rk,
                                            yc, yv, av, zv, 0, s->n, 0, s->n, d);
                     }
-                    else scm_bound_node(s, yv[i], yc, yv, av, zv);
+                    else scm_bound_node(s, yv[i], rk, yc, yv, av, zv);
                 }
             }
 
@@ -483,58 +893,45 @@ static bool scm_bound(scm *s, long long yc, const long long *yv,
         }
         free(pp);
     }
+    rkfree(rk);
     return st;
 }
 
 //------------------------------------------------------------------------------
 
-// Append a page at the current SCM TIFF file pointer. Offset b is the previous
-// IFD, which will be updated to include the new page as next. x is the breadth-
-// first page index. f points to a page of data to be written. Return the offset
-// of the new page.
+// Commit a page with IFD d and sc encoded strips zv of lengths l to SCM s,
+// linking it after the IFD at offset b. The page extent is gathered into a
+// single buffer and written at the end of the file, or queued for writing if
+// write-behind is enabled. Return the offset of the new page.
 
-long long scm_append(scm *s, long long b, long long x, const float *f)
+static long long scm_commit(scm *s, long long b, ifd *d, uint8_t **zv,
+                                               const uint32_t *l, uint16_t sc)
 {
-    assert(s);
-    assert(f);
-
     long long o;
-    uint64_t oo;
-    uint64_t lo;
-    uint16_t sc;
+    uint8_t  *p;
+    size_t    n;
 
-    ifd d;
-
-    if (scm_init_ifd(s, &d))
+    if ((o = scm_write_tail(s)) > 0)
     {
-        if (scm_ffwd(s))
+        if ((p = scm_pack_zips(s, d, zv, l, sc, o, &n)))
         {
-            if ((o = scm_write_ifd(s, &d, 0)) >= 0)
+            if (s->wq)
             {
-                if ((scm_write_data(s, f, &oo, &lo, &sc)))
+                if (scm_write_queue(s, o, b, p, n))
                 {
-                    if (scm_align(s) >= 0)
-                    {
-                        uint64_t rr = (uint64_t) s->r;
-                        uint64_t xx = (uint64_t) x;
+                    return o;
+                }
+            }
+            else
+            {
+                bool st = scm_write_at(s, p, n, o) && scm_link_list(s, o, b);
 
-                        scm_field(&d.strip_offsets,     0x0111, 16, sc, oo);
-                        scm_field(&d.rows_per_strip,    0x0116,  3,  1, rr);
-                        scm_field(&d.strip_byte_counts, 0x0117,  4, sc, lo);
-                        scm_field(&d.page_number,       0x0129,  4,  1, xx);
+                free(p);
 
-                        if (scm_write_ifd(s, &d, o) >= 1)
-                        {
-                            if (scm_link_list(s, o, b))
-                            {
-                                if (scm_ffwd(s))
-                                {
-                                    fflush(s->fp);
-                                    return o;
-                                }
-                            }
-                        }
-                    }
+                if (st)
+                {
+                    scm_flush(s);
+                    return o;
                 }
             }
         }
@@ -542,12 +939,83 @@ long long scm_append(scm *s, long long b, long long x, const float *f)
     return 0;
 }
 
+// Append a float or raw page at the current SCM TIFF file pointer.
+
+static long long scm_append_data(scm *s, long long b, long long x,
+                                 const void *p, bool raw)
+{
+    uint16_t sc;
+
+    ifd d;
+
+    if (scm_init_ifd(s, &d))
+    {
+        uint64_t xx = (uint64_t) x;
+        int      z;
+
+        if (scm_code_data(s, p, raw, s->zipl, &sc, &z))
+        {
+            scm_field(&d.page_number, 0x0129, 4, 1, xx);
+            scm_field(&d.compression, 0x0103, 3, 1, (uint64_t) z);
+
+            if (z == SCM_COMPRESS_NONE || z == SCM_COMPRESS_CONST)
+                scm_field(&d.predictor, 0x013D, 3, 1, 1);
+
+            return scm_commit(s, b, &d, s->zipv, s->zipl, sc);
+        }
+    }
+    return 0;
+}
+
+// Append a page at the current SCM TIFF file pointer. Offset b is the previous
+// IFD, which will be updated to include the new page as next. x is the breadth-
+// first page index. f points to a page of data to be written. Return the offset
+// of the new page.
+
+long long scm_append(scm *s, long long b, long long x, const float *f)
+{
+    assert(s);
+    assert(f);
+
+    return scm_append_data(s, b, x, f, false);
+}
+
+// Append a page of samples of the native type of SCM s, as with scm_append. No
+// conversion is performed.
+
+long long scm_append_raw(scm *s, long long b, long long x, const void *p)
+{
+    assert(s);
+    assert(p);
+
+    return scm_append_data(s, b, x, p, true);
+}
+
+// Repeat a constant page of SCM t at offset o with index x to SCM s, which does
+// not store constant pages, by decoding it and appending it anew.
+
+static long long scm_expand(scm *s, long long b, scm *t, long long o,
+                                                          long long x)
+{
+    long long a = 0;
+    void     *p;
+
+    if ((p = scm_alloc_raw_buffer(t)))
+    {
+        if (scm_read_page_raw(t, o, p))
+            a = scm_append_raw(s, b, x, p);
+
+        free(p);
+    }
+    return a;
+}
+
 // Repeat a page at the current file pointer of SCM s. As with append, offset b
 // is the previous IFD, which will be updated to include the new page as next.
 // The source data is at offset o of SCM t. SCMs s and t must have the same data
 // type and size, as this allows the operation to be performed without decoding
 // s or encoding t. If data types do not match, then a read from s and an append
-// to t are required.
+// to t are required. A constant page is expanded unless s stores them.
 
 long long scm_repeat(scm *s, long long b, scm *t, long long o)
 {
@@ -558,54 +1026,79 @@ long long scm_repeat(scm *s, long long b, scm *t, long long o)
     assert(s->b == t->b);
     assert(s->g == t->g);
     assert(s->r == t->r);
+    assert(s->t == t->t);
 
-    ifd d;
+    long long a;
+    ifd       d;
 
-    if (scm_read_ifd(t, &d, o))
+    if (scm_sync(t, o) && scm_stage_ifd(t, &d, o))
     {
-        uint64_t oo = (uint64_t) d.strip_offsets.offset;
-        uint64_t lo = (uint64_t) d.strip_byte_counts.offset;
         uint16_t sc = (uint16_t) d.strip_byte_counts.count;
+        uint64_t rr = (uint64_t) s->r;
 
-        uint64_t O[256];
-        uint32_t L[256];
+        const bool k = (d.compression.offset == SCM_COMPRESS_CONST);
 
-        d.next = 0;
+        if (k && !s->u)
+            return scm_expand(s, b, t, o, (long long) d.page_number.offset);
 
-        if (scm_read_zips(t, t->zipv, oo, lo, sc, O, L))
+        if (sc > scm_strips(t))
         {
-            if ((o = scm_write_ifd(s, &d, 0)) >= 0)
-            {
-                if (scm_write_zips(s, t->zipv, &oo, &lo, &sc, O, L))
-                {
-                    if (scm_align(s) >= 0)
-                    {
-                        uint64_t rr = (uint64_t) s->r;
+            apperr("%s: Page has %d strips, expected at most %d",
+                    t->name, sc, scm_strips(t));
+            return 0;
+        }
 
-                        scm_field(&d.strip_offsets,     0x0111, 16, sc, oo);
-                        scm_field(&d.rows_per_strip,    0x0116,  3,  1, rr);
-                        scm_field(&d.strip_byte_counts, 0x0117,  4, sc, lo);
+        for (int i = 0; i < sc; i++)
+            t->zipp[i] = t->zipv[i];
 
-                        if (scm_write_ifd(s, &d, o) >= 0)
-                        {
-                            if (scm_link_list(s, o, b))
-                            {
-                                if (scm_ffwd(s))
-                                {
-                                    fflush(s->fp);
-                                    return o;
-                                }
-                            }
-                        }
-                    }
-                }
+        if (scm_read_zips(t, t->zipp, &d, t->zipo, t->zipl))
+        {
+            d.next = 0;
+
+            scm_field(&d.rows_per_strip, 0x0116, 3, 1, rr);
+
+            if ((a = scm_commit(s, b, &d, t->zipp, t->zipl, sc)) && k)
+            {
+                s->codn[SCM_CODE_CONST] += 1;
+                s->codr[SCM_CODE_CONST] += (long long) scm_page_size(s, true);
+                s->codz[SCM_CODE_CONST] += (long long) t->zipl[0];
             }
+            return a;
         }
     }
-
     return 0;
 }
 
+// Enable write-behind on SCM s, allowing up to n encoded pages to be queued
+// while a background thread writes them. Disable it if n is zero, blocking
+// until all queued pages are written. Return false on failure, in which case
+// all writes remain synchronous.
+
+bool scm_write_behind(scm *s, int n)
+{
+    assert(s);
+    assert(n >= 0);
+
+    return scm_write_queue_init(s, n);
+}
+
+// Return the count of pages appended to SCM s with adaptive compression outcome
+// o, one of SCM_CODE_STORE, SCM_CODE_FAST, SCM_CODE_FULL, or SCM_CODE_CONST,
+// along with their total uncompressed and compressed sizes in bytes. Pages
+// appended without the adaptive level are counted as stored or full according
+// to their scheme, and constant pages are counted as such under any scheme.
+
+void scm_get_code_stats(scm *s, int o, long long *n, long long *r, long long *z)
+{
+    assert(s);
+    assert(n);
+    assert(r);
+    assert(z);
+    assert(0 <= o && o < 4);
+
+    scm_code_stats(s, o, n, r, z);
+}
+
 // Move the SCM TIFF file pointer to the first IFD and return its offset.
 
 long long scm_rewind(scm *s)
@@ -615,7 +1108,7 @@ long long scm_rewind(scm *s)
 
     assert(s);
 
-    if (scm_read_header(s, &h))
+    if (scm_sync(s, -1) && scm_read_header(s, &h))
     {
         if (scm_read_hfd(s, &d, h.first_ifd))
         {
@@ -638,6 +1131,7 @@ bool scm_finish(scm *s, const char *txt, int d)
 
     long long  xc =    0;
     long long *xv = NULL;
+    long long *xo = NULL;
     long long  yc =    0;
     long long *yv = NULL;
     long long  oc =    0;
@@ -649,13 +1143,13 @@ bool scm_finish(scm *s, const char *txt, int d)
 
     // Allocate and initialize buffers for all metadata data.
 
-    if ((xc = scm_scan_indices(s, &xv)))
+    if ((xc = scm_scan_pages(s, &xv, &xo)))
     {
         if ((yc = scm_grow_leaves(s, &yv, xc, xv, d)))
         {
-            if ((oc = scm_scan_offsets(s, &ov, yc, yv)))
+            if ((oc = scm_scan_offsets(&ov, yc, yv, xc, xv, xo)))
             {
-                if (scm_bound(s, yc, yv, oc, ov, &minv, &maxv, d))
+                if (scm_bound(s, yc, yv, ov, &minv, &maxv, d))
                 {
                     // Append all metadata.
 
@@ -668,7 +1162,10 @@ bool scm_finish(scm *s, const char *txt, int d)
                     uint64_t zo = 0;
                     uint64_t to = 0;
 
-                    if (scm_ffwd(s))
+                    // Align the arrays so that readers may map them.
+
+                    if (scm_ffwd(s) &&
+                        scm_align(s, (int) sizeof (long long)) >= 0)
                     {
                         yo = scm_write(s,   yv, (size_t) yc * sizeof (long long));
                         oo = scm_write(s,   ov, (size_t) oc * sizeof (long long));
@@ -704,6 +1201,7 @@ bool scm_finish(scm *s, const char *txt, int d)
     free(minv);
     free(yv);
     free(ov);
+    free(xo);
     free(xv);
 
     return st;
@@ -722,7 +1220,7 @@ bool scm_polish(scm *s)
     hfd    d;
     ifd    i;
 
-    if (scm_read_header(s, &h))
+    if (scm_sync(s, -1) && scm_read_header(s, &h))
     {
         if (scm_read_hfd(s, &d, h.first_ifd))
         {
@@ -739,31 +1237,258 @@ bool scm_polish(scm *s)
 
 //------------------------------------------------------------------------------
 
-// Read the SCM TIFF IFD at offset o. Assume p provides space for one page of
-// data to be stored.
+// Read the SCM TIFF IFD at offset o, along with the float or raw page it
+// describes.
 
-bool scm_read_page(scm *s, long long o, float *p)
+static bool scm_read_page_data(scm *s, long long o, void *p, bool raw)
 {
     ifd i;
 
-    assert(s);
+    if (s->cache && scm_cache_get(s, o, p, raw))
+        return true;
 
-    if (scm_read_ifd(s, &i, o))
+    if (scm_sync(s, o) && scm_stage_ifd(s, &i, o))
     {
-        uint64_t oo = (uint64_t) i.strip_offsets.offset;
-        uint64_t lo = (uint64_t) i.strip_byte_counts.offset;
-        uint16_t sc = (uint16_t) i.strip_byte_counts.count;
+        if (scm_read_data(s, p, raw, &i))
+        {
+            if (s->cache)
+                scm_cache_put(s, o, p, raw);
 
-        return scm_read_data(s, p, oo, lo, sc);
+            return true;
+        }
+        return false;
     }
     else apperr("Failed to read SCM TIFF IFD from %s", s->name);
 
     return false;
 }
 
+// Read the SCM TIFF IFD at offset o, along with the page it describes. Assume p
+// provides space for one page of data to be stored.
+
+bool scm_read_page(scm *s, long long o, float *p)
+{
+    assert(s);
+
+    return scm_read_page_data(s, o, p, false);
+}
+
+// Read the page at offset o as samples of the native type of SCM s. Assume p
+// provides space for one such page, as given by scm_alloc_raw_buffer.
+
+bool scm_read_page_raw(scm *s, long long o, void *p)
+{
+    assert(s);
+
+    return scm_read_page_data(s, o, p, true);
+}
+
+// Read a region of a float or raw page.
+
+static bool scm_read_region_data(scm *s, long long o, int x0, int y0,
+                                                      int x1, int y1,
+                                                      void *p, bool raw)
+{
+    ifd i;
+
+    if (s->cache && scm_cache_get(s, o, p, raw))
+        return true;
+
+    if (scm_sync(s, o) && scm_read_ifd(s, &i, o))
+    {
+        return scm_read_part(s, p, raw, &i, max(x0, 0),
+                                            max(y0, 0),
+                                            min(x1, s->n + 2),
+                                            min(y1, s->n + 2));
+    }
+    else apperr("Failed to read SCM TIFF IFD from %s", s->name);
+
+    return false;
+}
+
+// Read the region of the page at offset o of SCM s spanning columns x0 through
+// x1 - 1 and rows y0 through y1 - 1. Only the strips or tiles intersecting the
+// region are read and decoded, though each is decoded in full, so samples of p
+// near the region may also be written. p must provide space for a full page.
+
+bool scm_read_region(scm *s, long long o, int x0, int y0,
+                                          int x1, int y1, float *p)
+{
+    assert(s);
+    assert(p);
+
+    return scm_read_region_data(s, o, x0, y0, x1, y1, p, false);
+}
+
+// Read a region of the page at offset o as samples of the native type of SCM s,
+// as with scm_read_region.
+
+bool scm_read_region_raw(scm *s, long long o, int x0, int y0,
+                                              int x1, int y1, void *p)
+{
+    assert(s);
+    assert(p);
+
+    return scm_read_region_data(s, o, x0, y0, x1, y1, p, true);
+}
+
+// Cache up to n bytes of decoded pages of SCM s, so that repeated reads of the
+// same page need not decode it again. Disable the cache if n is zero.
+
+bool scm_set_cache(scm *s, size_t n)
+{
+    assert(s);
+
+    return scm_cache_init(s, n);
+}
+
+// Return the decoded page cache hit and miss counts of SCM s.
+
+void scm_get_cache_stats(scm *s, long long *hits, long long *misses)
+{
+    assert(s);
+    assert(hits);
+    assert(misses);
+
+    scm_cache_stats(s, hits, misses);
+}
+
+// Hint that SCM s will be read with access pattern a, one of SCM_ACCESS_NORMAL,
+// SCM_ACCESS_SEQUENTIAL, or SCM_ACCESS_RANDOM.
+
+void scm_access(scm *s, int a)
+{
+    assert(s);
+
+    scm_advise(s, a);
+}
+
+// Hint that the n pages at offsets o of SCM s will soon be read, allowing the
+// operating system to begin fetching them. Zero offsets are ignored.
+
+void scm_prefetch(scm *s, const long long *o, int n)
+{
+    assert(s);
+    assert(o);
+
+    for (int i = 0; i < n; i++)
+        if (o[i])
+            scm_prefetch_page(s, o[i]);
+}
+
+// Start n worker threads to service asynchronous page reads of SCM s, or stop
+// them if n is zero. Return false on failure, in which case asynchronous reads
+// are performed synchronously.
+
+bool scm_read_threads(scm *s, int n)
+{
+    assert(s);
+    assert(n >= 0);
+
+    return scm_read_pool_init(s, n);
+}
+
+// Read the page at offset o of SCM s into buffer p without waiting. When the
+// read completes, call f with the page and user data d. With worker threads
+// running, f is called from a worker and must be thread-safe. Otherwise, the
+// read is synchronous, f is called before return, and the result is returned.
+
+bool scm_read_page_async(scm *s, long long o, float *p, scm_read_fn f, void *d)
+{
+    assert(s);
+    assert(p);
+
+    if (s->rq)
+    {
+        if (scm_sync(s, o))
+        {
+            return scm_read_queue(s, o, p, f, d);
+        }
+        return false;
+    }
+    else
+    {
+        bool ok = scm_read_page(s, o, p);
+
+        if (f)
+            f(s, o, p, ok, d);
+
+        return ok;
+    }
+}
+
+// Block until all asynchronous reads of SCM s are complete. Return false if any
+// has failed since the previous wait.
+
+bool scm_read_wait(scm *s)
+{
+    assert(s);
+
+    return scm_read_drain(s);
+}
+
 //------------------------------------------------------------------------------
 
-// Read the index and offset catalog metadata.
+// Fill the subtree at node k of the Eytzinger-ordered search tree of SCM s from
+// catalog entry i onward. Node k has children 2k and 2k + 1, so an in-order walk
+// visits the nodes in the sorted order of the catalog. Return the next entry.
+
+static long long scm_eytzinger(scm *s, long long i, long long k)
+{
+    if (k <= s->en)
+    {
+        i = scm_eytzinger(s, i, 2 * k);
+
+        s->ev[k] = s->xv[i];
+        s->ei[k] = i;
+
+        i = scm_eytzinger(s, i + 1, 2 * k + 1);
+    }
+    return i;
+}
+
+// Build the search structures of the catalog of SCM s. The shallow pages are
+// found through a presence bitmap, and the rest through a search tree. The tree
+// keeps the nodes of the first levels of every search together at the front,
+// and each descent doubles its node number, so the nodes a search will visit a
+// few levels ahead are adjacent and may be prefetched. On failure, searches
+// fall back to binary search of the catalog itself.
+
+static void scm_index_catalog(scm *s)
+{
+    long long p = 0;
+
+    // Skip the entries covered by the bitmap, if any.
+
+    if ((s->rk = rkinit(s->xc, s->xv)))
+    {
+        const long long j = (s->rk->m - 1) >> 6;
+
+        p = s->rk->r[j] + popcount(s->rk->b[j]);
+    }
+
+    s->en = s->xc - p;
+
+    const size_t n = (size_t) s->en + 1;
+
+    if ((s->ev = (long long *) malloc(n * sizeof (long long))) &&
+        (s->ei = (long long *) malloc(n * sizeof (long long))))
+    {
+        s->ev[0] = 0;
+        s->ei[0] = -1;
+
+        scm_eytzinger(s, p, 1);
+    }
+    else
+    {
+        free(s->ev);
+        s->ev = NULL;
+    }
+}
+
+// Read the index and offset catalog metadata. The arrays are mapped where
+// possible rather than read, so that the catalog of even a huge file is ready
+// at once, and processes reading the same file share one copy of it.
 
 bool scm_read_catalog(scm *s)
 {
@@ -778,47 +1503,43 @@ bool scm_read_catalog(scm *s)
         {
             // Determine the metadata sizes.
 
-            long long  xc = (long long) d.page_index.count;
-            long long  oc = (long long) d.page_offset.count;
-            size_t     xs = xc * sizeof (long long);
-            size_t     os = oc * sizeof (long long);
-            long long *xv = NULL;
-            long long *ov = NULL;
+            long long xc = (long long) d.page_index .count;
+            long long oc = (long long) d.page_offset.count;
+            long long xo = (long long) d.page_index .offset;
+            long long oo = (long long) d.page_offset.offset;
 
-            // Try to allocate storage and read the metadata.
+            void  *xm;
+            void  *om;
+            size_t xl;
+            size_t ol;
 
-            if (xc && (xv = (long long *) malloc(xs)))
-                if (scm_read(s, xv, xs, d.page_index.offset) == false)
-                {
-                    free(xv);
-                    xc = 0;
-                }
+            // Try to map or read the metadata.
 
-            if (oc && (ov = (long long *) malloc(os)))
-                if (scm_read(s, ov, os, d.page_offset.offset) == false)
-                {
-                    free(ov);
-                    oc = 0;
-                }
+            long long *xv = scm_load_array(s, xc, xo, &xm, &xl);
+            long long *ov = scm_load_array(s, oc, oo, &om, &ol);
 
             // On success, replace any current metadata.
 
-            if (xc && oc)
+            if (xv && ov)
             {
-                if (s->xv) free(s->xv);
-                if (s->ov) free(s->ov);
+                scm_free_catalog(s);
 
                 s->xv = xv;
                 s->xc = xc;
+                s->xm = xm;
+                s->xl = xl;
                 s->ov = ov;
                 s->oc = oc;
+                s->om = om;
+                s->ol = ol;
 
+                scm_index_catalog(s);
                 return true;
             }
             else
             {
-                if (xv) free(xv);
-                if (ov) free(ov);
+                scm_free_array(xv, xm, xl);
+                scm_free_array(ov, om, ol);
 
                 return false;
             }
@@ -835,17 +1556,15 @@ bool scm_scan_catalog(scm *s)
 
     // Release any existing catalog buffers.
 
-    if (s->xv) free(s->xv);
-    if (s->ov) free(s->ov);
+    scm_free_catalog(s);
 
     // Scan the indices and offsets.
 
-    if ((s->xc = scm_scan_indices(s, &s->xv)))
+    if ((s->xc = scm_scan_pages(s, &s->xv, &s->ov)))
     {
-        if ((s->oc = scm_scan_offsets(s, &s->ov, s->xc, s->xv)))
-        {
-            return true;
-        }
+        s->oc = s->xc;
+        scm_index_catalog(s);
+        return true;
     }
     return false;
 }
@@ -880,7 +1599,11 @@ long long scm_get_offset(scm *s, long long i)
     return s->ov[i];
 }
 
-// Search for the catalog entry of a given page index.
+// Search for the catalog entry of a given page index. A page covered by the
+// presence bitmap is found in constant time. Otherwise the search tree is
+// descended without branching on the comparison, prefetching the block of
+// nodes three levels below. The path taken ends with a run of right turns after
+// the last left turn, which was at the first node not less than x.
 
 long long scm_search(scm *s, long long x)
 {
@@ -891,10 +1614,31 @@ long long scm_search(scm *s, long long x)
     if (x < s->xv[        0]) return -1;
     if (x > s->xv[s->xc - 1]) return -1;
 
+    if (s->rk && x < s->rk->m)
+        return rksearch(s->rk, x, s->xc, s->xv);
+
+    if (s->ev)
+    {
+        long long k = 1;
+
+        while (k <= s->en)
+        {
+            prefetch(s->ev + 8 * k);
+            k = 2 * k + (long long) (s->ev[k] < x);
+        }
+
+        while (k & 1)
+            k >>= 1;
+
+        k >>= 1;
+
+        return (s->ev[k] == x) ? s->ei[k] : -1;
+    }
     return llsearch(x, s->xc, s->xv);
 }
 
-// "Forget" a page of data by zeroing its offset.
+// "Forget" a page of data by zeroing its offset. A mapped catalog is private,
+// so this copies the affected page of the mapping and leaves the file alone.
 
 void scm_forget(scm *s, long long i)
 {
@@ -24,15 +24,30 @@ void scm_close(scm *);
 scm *scm_ifile(const char *);
 scm *scm_ofile(const char *, int, int, int, int);
 
+scm *scm_ifile_io(const char *, int);
+scm *scm_ofile_io(const char *, int, int, int, int, int, int);
+
+scm *scm_reader(scm *);
+
+bool scm_set_tile(scm *, int);
+bool scm_set_compression(scm *, int, int);
+void scm_set_constant(scm *, bool);
+bool scm_parse_compression(const char *, int *, int *);
+
 //------------------------------------------------------------------------------
 // SCM TIFF parameter queries
 
 float *scm_alloc_buffer(scm *);
+void  *scm_alloc_raw_buffer(scm *);
 
 int scm_get_n(scm *);
 int scm_get_c(scm *);
 int scm_get_b(scm *);
 int scm_get_g(scm *);
+int scm_get_r(scm *);
+int scm_get_t(scm *);
+int scm_get_z(scm *);
+int scm_get_l(scm *);
 
 void scm_get_sample_corners(int, long, long, long, double *);
 void scm_get_sample_center (int, long, long, long, double *);
@@ -42,11 +57,29 @@ void scm_get_sample_center (int, long, long, long, double *);
 
 long long scm_rewind(scm *);
 long long scm_append(scm *, long long, long long, const float *);
+long long scm_append_raw(scm *, long long, long long, const void *);
 long long scm_repeat(scm *, long long, scm *, long long);
 bool      scm_finish(scm *, const char *, int);
 bool      scm_polish(scm *);
 
-bool scm_read_page(scm *, long long, float *);
+bool scm_write_behind  (scm *, int);
+void scm_get_code_stats(scm *, int, long long *, long long *, long long *);
+
+bool scm_read_page  (scm *, long long, float *);
+bool scm_read_region(scm *, long long, int, int, int, int, float *);
+
+bool scm_read_page_raw  (scm *, long long, void *);
+bool scm_read_region_raw(scm *, long long, int, int, int, int, void *);
+
+bool scm_set_cache      (scm *, size_t);
+void scm_get_cache_stats(scm *, long long *, long long *);
+
+void scm_access  (scm *, int);
+void scm_prefetch(scm *, const long long *, int);
+
+bool scm_read_threads   (scm *, int);
+bool scm_read_page_async(scm *, long long, float *, scm_read_fn, void *);
+bool scm_read_wait      (scm *);
 
 //------------------------------------------------------------------------------
 // SCM TIFF metadata search.
@@ -11,9 +11,18 @@
 // more details.
 
 #include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
 #include <stdio.h>
 #include <zlib.h>
 
+#ifdef HAVE_ZSTD
+#include <zstd.h>
+#endif
+#ifdef HAVE_LZ4
+#include <lz4frame.h>
+#endif
+
 #include "scmdat.h"
 #include "util.h"
 
@@ -67,6 +76,85 @@ bool is_ifd(ifd *ip)
     return true;
 }
 
+bool is_tfd(tfd *tp)
+{
+    if (tp->count                 != SCM_IFD_COUNT)    return false;
+    if (tp->image_width.tag       != 0x0100)           return false;
+    if (tp->image_length.tag      != 0x0101)           return false;
+    if (tp->bits_per_sample.tag   != 0x0102)           return false;
+    if (tp->compression.tag       != 0x0103)           return false;
+    if (tp->interpretation.tag    != 0x0106)           return false;
+    if (tp->orientation.tag       != 0x0112)           return false;
+    if (tp->samples_per_pixel.tag != 0x0115)           return false;
+    if (tp->predictor.tag         != 0x013D)           return false;
+    if (tp->tile_width.tag        != 0x0142)           return false;
+    if (tp->tile_length.tag       != 0x0143)           return false;
+    if (tp->tile_offsets.tag      != 0x0144)           return false;
+    if (tp->tile_byte_counts.tag  != 0x0145)           return false;
+    if (tp->sample_format.tag     != 0x0153)           return false;
+    return true;
+}
+
+// Convert between the stripped IFD used in memory and the tiled IFD used in
+// the file. The tile offset and byte count arrays take the place of the strip
+// offset and byte count arrays, and tiles are t by t samples square.
+
+void scm_tile_ifd(tfd *t, const ifd *d, int w)
+{
+    t->count             = d->count;
+    t->image_width       = d->image_width;
+    t->image_length      = d->image_length;
+    t->bits_per_sample   = d->bits_per_sample;
+    t->compression       = d->compression;
+    t->interpretation    = d->interpretation;
+    t->orientation       = d->orientation;
+    t->samples_per_pixel = d->samples_per_pixel;
+    t->page_number       = d->page_number;
+    t->predictor         = d->predictor;
+    t->tile_width        = d->rows_per_strip;
+    t->tile_length       = d->rows_per_strip;
+    t->tile_offsets      = d->strip_offsets;
+    t->tile_byte_counts  = d->strip_byte_counts;
+    t->sample_format     = d->sample_format;
+    t->next              = d->next;
+
+    t->tile_width      .tag    = 0x0142;
+    t->tile_width      .offset = (uint64_t) w;
+    t->tile_length     .tag    = 0x0143;
+    t->tile_length     .offset = (uint64_t) w;
+    t->tile_offsets    .tag    = 0x0144;
+    t->tile_byte_counts.tag    = 0x0145;
+}
+
+void scm_untile_ifd(ifd *d, const tfd *t)
+{
+    memset(&d->configuration, 0, sizeof (field));
+
+    d->count             = t->count;
+    d->image_width       = t->image_width;
+    d->image_length      = t->image_length;
+    d->bits_per_sample   = t->bits_per_sample;
+    d->compression       = t->compression;
+    d->interpretation    = t->interpretation;
+    d->strip_offsets     = t->tile_offsets;
+    d->orientation       = t->orientation;
+    d->samples_per_pixel = t->samples_per_pixel;
+    d->rows_per_strip    = t->tile_length;
+    d->strip_byte_counts = t->tile_byte_counts;
+    d->page_number       = t->page_number;
+    d->predictor         = t->predictor;
+    d->sample_format     = t->sample_format;
+    d->next              = t->next;
+
+    d->strip_offsets    .tag    = 0x0111;
+    d->rows_per_strip   .tag    = 0x0116;
+    d->strip_byte_counts.tag    = 0x0117;
+    d->configuration    .tag    = 0x011C;
+    d->configuration    .type   = 3;
+    d->configuration    .count  = 1;
+    d->configuration    .offset = 1;
+}
+
 //------------------------------------------------------------------------------
 
 // Return the size in bytes of a datum of the given TIFF type;
@@ -107,6 +195,7 @@ uint64_t scm_pint(scm *s)
 uint16_t scm_form(scm *s)
 {
     if (s->b == 32) return 3;     // IEEE floating point
+    if (s->g == 2)  return 3;     // IEEE half-precision floating point
     if (s->g)       return 2;     // Signed integer data
     else            return 1;     // Unsigned integer data
 }
@@ -118,7 +207,11 @@ uint16_t scm_type(scm *s)
     if (s->b == 32) return 11;    // FLOAT
     if (s->b == 64) return 12;    // DOUBLE
 
-    if (s->g)
+    if (s->g == 2)                // TIFF has no half type, so store bits
+    {
+        if (s->b == 16) return 3; // SHORT
+    }
+    else if (s->g)
     {
         if (s->b ==  8) return 6; // SBYTE
         if (s->b == 16) return 8; // SSHORT
@@ -131,12 +224,56 @@ uint16_t scm_type(scm *s)
     return 7;                     // UNDEFINED
 }
 
-// Choose a horizontal differencing predection algorithm for this data.
+// Determine and return the number of strips, or tiles, in each page.
+
+int scm_strips(scm *s)
+{
+    if (s->t)
+    {
+        const int m = (s->n + 2 + s->t - 1) / s->t;
+        return m * m;
+    }
+    return (s->n + 2 + s->r - 1) / s->r;
+}
+
+// Determine and return the size in bytes of each row of each strip, or tile.
+
+size_t scm_row_size(scm *s)
+{
+    return (size_t) (s->t ? s->t : s->n + 2)
+         * (size_t)  s->c * (size_t) s->b / 8;
+}
+
+// Determine and return the decoded size in bytes of each strip, or tile.
+
+size_t scm_strip_size(scm *s)
+{
+    if (s->t)
+        return (size_t) s->t * (size_t) s->t
+             * (size_t) s->c * (size_t) s->b / 8;
+    else
+        return (size_t) s->r * (size_t) (s->n + 2)
+             * (size_t) s->c * (size_t)  s->b / 8;
+}
+
+// Determine and return the size in bytes of each page in memory, holding either
+// floats or, if raw is set, samples of the native type.
+
+size_t scm_page_size(scm *s, bool raw)
+{
+    return (size_t) (s->n + 2) * (size_t) (s->n + 2) * (size_t) s->c
+         * (raw ? (size_t) s->b / 8 : sizeof (float));
+}
+
+// Choose a horizontal differencing predection algorithm for this data: integer
+// differencing for integer samples, and floating point differencing for floats.
+// Half floats are differenced as integers, which their bit patterns order.
 
 uint64_t scm_hdif(scm *s)
 {
     if (s->b ==  8) return 2;
     if (s->b == 16) return 2;
+    if (s->b == 32) return 3;
 
     return 1;
 }
@@ -161,10 +298,74 @@ static inline float uclamp(float k)
     else               return    k;
 }
 
+// Convert a float to IEEE half precision, rounding to nearest even. Overflow
+// becomes infinity, and NaN remains NaN, as with the F16C instructions.
+
+static inline uint16_t ftoh(float f)
+{
+    uint32_t x;
+    uint32_t a;
+    uint16_t h;
+
+    memcpy(&x, &f, sizeof (float));
+
+    h = (uint16_t) ((x >> 16) & 0x8000);
+    a =              x        & 0x7FFFFFFF;
+
+    if (a > 0x7F800000)                         // NaN
+        return h | (uint16_t) (0x7E00 | ((a >> 13) & 0x3FF));
+    if (a >= 0x477FF000)                        // Infinity or overflow
+        return h | (uint16_t) 0x7C00;
+
+    if (a < 0x38800000)                         // Subnormal or zero
+    {
+        // Adding one half aligns the subnormal bits and rounds them.
+
+        float    k = 0.5f;
+        uint32_t u;
+
+        memcpy(&f, &a, sizeof (float));
+        f += k;
+        memcpy(&u, &f, sizeof (float));
+        memcpy(&a, &k, sizeof (float));
+
+        return h | (uint16_t) (u - a);
+    }
+
+    // Rebias the exponent and round the mantissa to nearest even.
+
+    a += 0xC8000FFF + ((a >> 13) & 1);
+
+    return h | (uint16_t) (a >> 13);
+}
+
+// Convert an IEEE half precision value to a float. This is exact.
+
+static inline float htof(uint16_t h)
+{
+    uint32_t x = (uint32_t) (h & 0x8000) << 16;
+    uint32_t e = (uint32_t) (h & 0x7C00);
+    uint32_t m = (uint32_t) (h & 0x03FF);
+    float    f;
+
+    if (e == 0x7C00)                            // Infinity or NaN
+        x |= 0x7F800000 | (m << 13) | (m ? 0x400000 : 0);
+    else if (e)                                 // Normal
+        x |= ((e >> 10) + 112) << 23 | (m << 13);
+    else if (m)                                 // Subnormal
+    {
+        f = (float) m / 16777216.f;
+        return (h & 0x8000) ? -f : f;
+    }
+
+    memcpy(&f, &x, sizeof (float));
+    return f;
+}
+
 // Encode the n values in floating point buffer f to the raw buffer p with
-// b bits per sample and sign s.
+// b bits per sample and format g. This is the scalar reference implementation.
 
-void ftob(void *p, const float *f, size_t n, int b, int g)
+void ftob_scalar(void *p, const float *f, size_t n, int b, int g)
 {
     size_t i;
 
@@ -184,15 +385,19 @@ void ftob(void *p, const float *f, size_t n, int b, int g)
         for (i = 0; i < n; ++i)
             ((short *) p)[i] = (short) (sclamp(f[i]) * 32767);
 
+    else if (b == 16 && g == 2)
+        for (i = 0; i < n; ++i)
+            ((uint16_t *) p)[i] = ftoh(f[i]);
+
     else if (b == 32)
         for (i = 0; i < n; ++i)
             ((float *) p)[i] = (float) (f[i]);
 }
 
 // Decode the n values in raw buffer p to the floating point buffer f assuming
-// b bits per sample and sign s.
+// b bits per sample and format g. This is the scalar reference implementation.
 
-void btof(const void *p, float *f, size_t n, int b, int g)
+void btof_scalar(const void *p, float *f, size_t n, int b, int g)
 {
     size_t i;
 
@@ -212,14 +417,33 @@ void btof(const void *p, float *f, size_t n, int b, int g)
         for (i = 0; i < n; ++i)
             f[i] = ((short *) p)[i] / 32767.f;
 
+    else if (b == 16 && g == 2)
+        for (i = 0; i < n; ++i)
+            f[i] = htof(((uint16_t *) p)[i]);
+
     else if (b == 32)
         for (i = 0; i < n; ++i)
             f[i] = ((float *) p)[i];
 }
 
-// Encode the given buffer using the horizontal differencing predictor.
+// Encode or decode using the SIMD kernels, if available, or the scalar code.
 
-void enhdif(void *p, int n, int c, int b)
+void ftob(void *p, const float *f, size_t n, int b, int g)
+{
+    if (!ftob_simd(p, f, n, b, g))
+        ftob_scalar(p, f, n, b, g);
+}
+
+void btof(const void *p, float *f, size_t n, int b, int g)
+{
+    if (!btof_simd(p, f, n, b, g))
+        btof_scalar(p, f, n, b, g);
+}
+
+// Encode the given buffer using the horizontal differencing predictor. This is
+// the scalar reference implementation.
+
+void enhdif_scalar(void *p, int n, int c, int b)
 {
     const int s = n * c;
     const int m = n - 1;
@@ -251,9 +475,10 @@ void enhdif(void *p, int n, int c, int b)
     }
 }
 
-// Decode the given buffer using the horizontal differencing predictor.
+// Decode the given buffer using the horizontal differencing predictor. This is
+// the scalar reference implementation.
 
-void dehdif(void *p, int n, int c, int b)
+void dehdif_scalar(void *p, int n, int c, int b)
 {
     const int s = n * c;
     const int m = n - 1;
@@ -285,71 +510,724 @@ void dehdif(void *p, int n, int c, int b)
     }
 }
 
+// Apply or reverse the predictor using the SIMD kernels, if available.
+
+void enhdif(void *p, int n, int c, int b)
+{
+    if (!enhdif_simd(p, n, c, b))
+        enhdif_scalar(p, n, c, b);
+}
+
+void dehdif(void *p, int n, int c, int b)
+{
+    if (!dehdif_simd(p, n, c, b))
+        dehdif_scalar(p, n, c, b);
+}
+
+// Encode a row of n pixels of c float channels using the floating point
+// predictor, as libtiff does. The first m pixels are taken from buffer f and
+// the rest are zero. The bytes of each sample are split into planes, most
+// significant first, and the whole row is then byte-differenced with stride c.
+// This assumes a little-endian host.
+
+void enfpdif(uint8_t *q, const float *f, int n, int m, int c)
+{
+    const int s = n * c;
+    const int k = m * c;
+
+    const uint8_t *p = (const uint8_t *) f;
+
+    for (int i = 0; i < k; ++i)
+    {
+        q[        i] = p[4 * i + 3];
+        q[    s + i] = p[4 * i + 2];
+        q[2 * s + i] = p[4 * i + 1];
+        q[3 * s + i] = p[4 * i + 0];
+    }
+    for (int j = 0; j < 4; ++j)
+        memset(q + j * s + k, 0, (size_t) (s - k));
+
+    enhdif(q, 4 * n, c, 8);
+}
+
+// Decode a row of n pixels of c float channels using the floating point
+// predictor, in place, and store the first m pixels to buffer f.
+
+void defpdif(uint8_t *q, float *f, int n, int m, int c)
+{
+    const int s = n * c;
+    const int k = m * c;
+
+    uint8_t *p = (uint8_t *) f;
+
+    dehdif(q, 4 * n, c, 8);
+
+    for (int i = 0; i < k; ++i)
+    {
+        p[4 * i + 3] = q[        i];
+        p[4 * i + 2] = q[    s + i];
+        p[4 * i + 1] = q[2 * s + i];
+        p[4 * i + 0] = q[3 * s + i];
+    }
+}
+
 //------------------------------------------------------------------------------
 // The following ancillary functions perform the fine-grained tasks of binary
 // data conversion, compression and decompression, and application of the
-// horizontal difference predictor. These are abstracted into tiny adapter
-// functions to ease the implementation of threaded file I/O with OpenMP.
+// horizontal difference predictor. These are fused into one pass per strip to
+// ease the implementation of threaded file I/O with OpenMP.
+
+//------------------------------------------------------------------------------
+// The following functions provide a uniform streaming interface to each of the
+// supported compression schemes. Strips are encoded by feeding rows in turn to
+// a codec, and decoded by drawing rows in turn from it. The store scheme copies
+// rows verbatim. Zstandard and LZ4 are optional, enabled by HAVE_ZSTD and
+// HAVE_LZ4.
 
-// Translate rows i through i+r from floating point to binary and back.
+typedef struct codec codec;
 
-void tobin(scm *s, uint8_t *bin, const float *dat, int i)
+struct codec
 {
-    const int n = s->n + 2;
-    const int m = s->c * n;
-    const int d = s->b * m / 8;
+    int      z;                 // Compression scheme
+    uint8_t *sp;                // Store pointer
+    size_t   sn;                // Store remaining
+    size_t   sl;                // Store length
+    z_stream zs;                // Deflate stream
+#ifdef HAVE_ZSTD
+    ZSTD_CCtx     *zc;          // Zstandard compression context
+    ZSTD_DCtx     *zd;          // Zstandard decompression context
+    ZSTD_inBuffer  zi;          // Zstandard input
+    ZSTD_outBuffer zo;          // Zstandard output
+#endif
+#ifdef HAVE_LZ4
+    LZ4F_cctx     *lc;          // LZ4 compression context
+    LZ4F_dctx     *ld;          // LZ4 decompression context
+    const uint8_t *lp;          // LZ4 input pointer
+    size_t         li;          // LZ4 input remaining
+    uint8_t       *lq;          // LZ4 output pointer
+    size_t         lo;          // LZ4 output remaining
+    size_t         ll;          // LZ4 output length
+#endif
+};
+
+// Zstandard and LZ4 contexts are costly to create, so each strip of an SCM
+// keeps one of each kind, created on first use and reset for each page.
+
+struct scm_ctx
+{
+    int            n;           // Unused, keeps the structure nonempty
+#ifdef HAVE_ZSTD
+    ZSTD_CCtx     *zc;          // Zstandard compression context
+    ZSTD_DCtx     *zd;          // Zstandard decompression context
+#endif
+#ifdef HAVE_LZ4
+    LZ4F_cctx     *lc;          // LZ4 compression context
+    LZ4F_dctx     *ld;          // LZ4 decompression context
+#endif
+};
+
+// Return the codec contexts of strip k of SCM s, or NULL on failure.
+
+static struct scm_ctx *getctx(scm *s, int k)
+{
+    if (s->ctxv == NULL)
+        return NULL;
+    if (s->ctxv[k] == NULL)
+        s->ctxv[k] = (struct scm_ctx *) calloc(1, sizeof (struct scm_ctx));
+
+    return s->ctxv[k];
+}
+
+// Release a set of codec contexts.
+
+void freectx(struct scm_ctx *x)
+{
+    if (x)
+    {
+#ifdef HAVE_ZSTD
+        ZSTD_freeCCtx(x->zc);
+        ZSTD_freeDCtx(x->zd);
+#endif
+#ifdef HAVE_LZ4
+        LZ4F_freeCompressionContext  (x->lc);
+        LZ4F_freeDecompressionContext(x->ld);
+#endif
+        free(x);
+    }
+}
 
-    for (int j = 0; j < s->r && i + j < n; ++j)
-        ftob(bin + j * d, dat + (i + j) * m, (size_t) m, s->b, s->g);
+#ifdef HAVE_LZ4
+static void lz4_prefs(LZ4F_preferences_t *p, int l)
+{
+    memset(p, 0, sizeof (LZ4F_preferences_t));
+    p->frameInfo.blockSizeID = LZ4F_max64KB;
+    p->compressionLevel      = (l < 0) ? 0 : l;
 }
+#endif
+
+// Return true if compression scheme z is supported by this build.
 
-void frombin(scm *s, const uint8_t *bin, float *dat, int i)
+bool scm_codec(int z)
+{
+    switch (z)
+    {
+        case SCM_COMPRESS_NONE:    return true;
+        case SCM_COMPRESS_DEFLATE: return true;
+#ifdef HAVE_ZSTD
+        case SCM_COMPRESS_ZSTD:    return true;
+#endif
+#ifdef HAVE_LZ4
+        case SCM_COMPRESS_LZ4:     return true;
+#endif
+    }
+    return false;
+}
+
+// Determine the worst-case compressed size of n bytes under any scheme. Pages
+// of differing schemes may be mixed in one file, so all share this bound.
+
+static size_t zipbound(size_t n)
+{
+    size_t b = (size_t) compressBound((uLong) n);
+#ifdef HAVE_ZSTD
+    b = max(b, ZSTD_compressBound(n));
+#endif
+#ifdef HAVE_LZ4
+    LZ4F_preferences_t p;
+    lz4_prefs(&p, 0);
+    b = max(b, LZ4F_compressFrameBound(n, &p));
+#endif
+    return b;
+}
+
+size_t scm_zip_size(scm *s)
+{
+    return zipbound(scm_strip_size(s));
+}
+
+// Begin encoding n bytes with scheme z at level l to buffer p of capacity m,
+// using the contexts x.
+
+static bool codec_enc(codec *c, struct scm_ctx *x, int z, int l, size_t n,
+                                                    uint8_t *p, size_t m)
+{
+    memset(c, 0, sizeof (codec));
+    c->z = z;
+
+    (void) x;
+    (void) n;
+
+    switch (z)
+    {
+        case SCM_COMPRESS_NONE:
+
+            c->sp = p;
+            c->sn = m;
+            return true;
+
+        case SCM_COMPRESS_DEFLATE:
+
+            if (deflateInit(&c->zs, (l < 0) ? Z_DEFAULT_COMPRESSION
+                                            : min(l, 9)) == Z_OK)
+            {
+                c->zs.next_out  = (Bytef *) p;
+                c->zs.avail_out = (uInt) m;
+                return true;
+            }
+            break;
+#ifdef HAVE_ZSTD
+        case SCM_COMPRESS_ZSTD:
+
+            if (x && (x->zc || (x->zc = ZSTD_createCCtx())))
+            {
+                c->zc = x->zc;
+
+                ZSTD_CCtx_reset       (c->zc, ZSTD_reset_session_only);
+                ZSTD_CCtx_setParameter(c->zc, ZSTD_c_compressionLevel,
+                                      (l < 0) ? ZSTD_CLEVEL_DEFAULT : l);
+                ZSTD_CCtx_setPledgedSrcSize(c->zc, (unsigned long long) n);
+
+                c->zo.dst  = p;
+                c->zo.size = m;
+                return true;
+            }
+            break;
+#endif
+#ifdef HAVE_LZ4
+        case SCM_COMPRESS_LZ4:
+
+            if (x && (x->lc || !LZ4F_isError(
+                       LZ4F_createCompressionContext(&x->lc, LZ4F_VERSION))))
+            {
+                LZ4F_preferences_t f;
+                size_t             k;
+
+                c->lc = x->lc;
+
+                lz4_prefs(&f, l);
+                f.frameInfo.contentSize = (unsigned long long) n;
+
+                if (!LZ4F_isError(k = LZ4F_compressBegin(c->lc, p, m, &f)))
+                {
+                    c->lq = p + k;
+                    c->lo = m - k;
+                    c->ll =     k;
+                    return true;
+                }
+            }
+            break;
+#endif
+    }
+    return false;
+}
+
+// Encode n bytes from buffer p. Finish the stream if this is the last buffer.
+
+static bool codec_put(codec *c, const uint8_t *p, size_t n, bool last)
+{
+    switch (c->z)
+    {
+        case SCM_COMPRESS_NONE:
+
+            if (n > c->sn)
+                return false;
+
+            memcpy(c->sp, p, n);
+            c->sp += n;
+            c->sn -= n;
+            c->sl += n;
+            return true;
+
+        case SCM_COMPRESS_DEFLATE:
+        {
+            c->zs.next_in  = (Bytef *) p;
+            c->zs.avail_in = (uInt) n;
+
+            int e = deflate(&c->zs, last ? Z_FINISH : Z_NO_FLUSH);
+
+            return last ? (e == Z_STREAM_END) : (e == Z_OK && !c->zs.avail_in);
+        }
+#ifdef HAVE_ZSTD
+        case SCM_COMPRESS_ZSTD:
+        {
+            ZSTD_inBuffer i = { p, n, 0 };
+            size_t        e;
+
+            do
+                if (ZSTD_isError(e = ZSTD_compressStream2(c->zc, &c->zo, &i,
+                                         last ? ZSTD_e_end : ZSTD_e_continue)))
+                    return false;
+            while (last ? (e != 0) : (i.pos < i.size));
+
+            return true;
+        }
+#endif
+#ifdef HAVE_LZ4
+        case SCM_COMPRESS_LZ4:
+        {
+            size_t k;
+
+            if (LZ4F_isError(k = LZ4F_compressUpdate(c->lc, c->lq, c->lo,
+                                                             p, n, NULL)))
+                return false;
+
+            c->lq += k;
+            c->lo -= k;
+            c->ll += k;
+
+            if (last)
+            {
+                k = LZ4F_compressEnd(c->lc, c->lq, c->lo, NULL);
+
+                if (LZ4F_isError(k))
+                    return false;
+
+                c->lq += k;
+                c->lo -= k;
+                c->ll += k;
+            }
+            return true;
+        }
+#endif
+    }
+    return false;
+}
+
+// Finish an encoder, returning the length of its output.
+
+static size_t codec_end_enc(codec *c)
+{
+    size_t n = 0;
+
+    switch (c->z)
+    {
+        case SCM_COMPRESS_NONE:
+            n = c->sl;
+            break;
+        case SCM_COMPRESS_DEFLATE:
+            n = (size_t) c->zs.total_out;
+            deflateEnd(&c->zs);
+            break;
+#ifdef HAVE_ZSTD
+        case SCM_COMPRESS_ZSTD:
+            n = c->zo.pos;
+            break;
+#endif
+#ifdef HAVE_LZ4
+        case SCM_COMPRESS_LZ4:
+            n = c->ll;
+            break;
+#endif
+    }
+    return n;
+}
+
+// Begin decoding with scheme z from buffer p of length n, using the contexts x.
+// A decoder may be abandoned before the end of its stream, so reset any context
+// before use.
+
+static bool codec_dec(codec *c, struct scm_ctx *x, int z, const uint8_t *p,
+                                                           size_t n)
+{
+    memset(c, 0, sizeof (codec));
+    c->z = z;
+
+    (void) x;
+
+    switch (z)
+    {
+        case SCM_COMPRESS_NONE:
+
+            c->sp = (uint8_t *) p;
+            c->sn = n;
+            return true;
+
+        case SCM_COMPRESS_DEFLATE:
+
+            if (inflateInit(&c->zs) == Z_OK)
+            {
+                c->zs.next_in  = (Bytef *) p;
+                c->zs.avail_in = (uInt) n;
+                return true;
+            }
+            break;
+#ifdef HAVE_ZSTD
+        case SCM_COMPRESS_ZSTD:
+
+            if (x && (x->zd || (x->zd = ZSTD_createDCtx())))
+            {
+                c->zd = x->zd;
+
+                ZSTD_DCtx_reset(c->zd, ZSTD_reset_session_only);
+
+                c->zi.src  = p;
+                c->zi.size = n;
+                return true;
+            }
+            break;
+#endif
+#ifdef HAVE_LZ4
+        case SCM_COMPRESS_LZ4:
+
+            if (x && (x->ld || !LZ4F_isError(
+                       LZ4F_createDecompressionContext(&x->ld, LZ4F_VERSION))))
+            {
+                c->ld = x->ld;
+
+                LZ4F_resetDecompressionContext(c->ld);
+
+                c->lp = p;
+                c->li = n;
+                return true;
+            }
+            break;
+#endif
+    }
+    return false;
+}
+
+// Decode exactly n bytes to buffer p.
+
+static bool codec_get(codec *c, uint8_t *p, size_t n)
+{
+    switch (c->z)
+    {
+        case SCM_COMPRESS_NONE:
+
+            if (n > c->sn)
+                return false;
+
+            memcpy(p, c->sp, n);
+            c->sp += n;
+            c->sn -= n;
+            return true;
+
+        case SCM_COMPRESS_DEFLATE:
+        {
+            c->zs.next_out  = (Bytef *) p;
+            c->zs.avail_out = (uInt) n;
+
+            return inflate(&c->zs, Z_SYNC_FLUSH) >= 0 && !c->zs.avail_out;
+        }
+#ifdef HAVE_ZSTD
+        case SCM_COMPRESS_ZSTD:
+        {
+            ZSTD_outBuffer o = { p, n, 0 };
+            size_t         a, b;
+
+            while (o.pos < o.size)
+            {
+                a = c->zi.pos;
+                b =    o.pos;
+
+                if (ZSTD_isError(ZSTD_decompressStream(c->zd, &o, &c->zi)))
+                    return false;
+                if (c->zi.pos == a && o.pos == b)
+                    return false;
+            }
+            return true;
+        }
+#endif
+#ifdef HAVE_LZ4
+        case SCM_COMPRESS_LZ4:
+        {
+            size_t i, o, m = 0;
+
+            while (m < n)
+            {
+                i = c->li;
+                o = n - m;
+
+                if (LZ4F_isError(LZ4F_decompress(c->ld, p + m, &o,
+                                                 c->lp, &i, NULL)))
+                    return false;
+                if (i == 0 && o == 0)
+                    return false;
+
+                c->lp += i;
+                c->li -= i;
+                m     += o;
+            }
+            return true;
+        }
+#endif
+    }
+    return false;
+}
+
+// Release a decoder.
+
+static void codec_end_dec(codec *c)
+{
+    if (c->z == SCM_COMPRESS_DEFLATE)
+        inflateEnd(&c->zs);
+}
+
+// Determine the bounds of strip or tile k: its first page row i and column j,
+// its valid row count h and column count w, and its stored row width x and row
+// count y. Tiles at the right and bottom edges of the page overhang it, and are
+// padded with zeros. Strips span the page width and end at its last row.
+
+static void strip_rect(scm *s, int k, int *i, int *j, int *h, int *w,
+                                                      int *x, int *y)
 {
     const int n = s->n + 2;
-    const int m = s->c * n;
-    const int d = s->b * m / 8;
 
-    for (int j = 0; j < s->r && i + j < n; ++j)
-        btof(bin + j * d, dat + (i + j) * m, (size_t) m, s->b, s->g);
+    if (s->t)
+    {
+        const int m = (n + s->t - 1) / s->t;
+
+        *i = (k / m) * s->t;
+        *j = (k % m) * s->t;
+        *h = min(s->t, n - *i);
+        *w = min(s->t, n - *j);
+        *x = s->t;
+        *y = s->t;
+    }
+    else
+    {
+        *i = k * s->r;
+        *j = 0;
+        *h = min(s->r, n - *i);
+        *w = n;
+        *x = n;
+        *y = *h;
+    }
 }
 
-// Apply or reverse the horizontal difference predector in rows i through i+r.
+// Encode strip or tile k of page dat to the zip buffer using scheme z at level
+// l, noting its compressed length in c. Each row is converted to binary,
+// differenced, and compressed in turn using the given row scratch buffer, which
+// thus remains cache-resident. Stored strips are not differenced, as TIFF does
+// not apply the predictor to uncompressed data. If raw is set, dat holds
+// samples of the native type, and conversion is skipped. Return the
+// uncompressed length, or zero if encoding fails.
 
-void todif(scm *s, uint8_t *bin, int i)
+size_t tostrip(scm *s, uint8_t *row, const void *dat, bool raw, int k,
+                                     uint8_t *zip, uint32_t *c, int z, int l)
 {
     const int n = s->n + 2;
-    const int d = s->c * s->b * n / 8;
+    int i, j, h, w, x, y;
+
+    strip_rect(s, k, &i, &j, &h, &w, &x, &y);
+
+    const int d = s->c * s->b * x / 8;
+    const int e = s->c * s->b * w / 8;
+
+    const size_t a = raw ? (size_t) s->b / 8 : sizeof (float);
+    const size_t m = (size_t) d * (size_t) y;
+    const bool   v = (z != SCM_COMPRESS_NONE);
+
+    bool  ok = false;
+    codec u;
+
+    *c = 0;
+
+    if (codec_enc(&u, getctx(s, k), z, l, m, zip, zipbound(m)))
+    {
+        ok = true;
+
+        for (int r = 0; ok && r < y; ++r)
+        {
+            const uint8_t *q = (const uint8_t *) dat
+                             + (size_t) (((i + r) * n + j) * s->c) * a;
+
+            if (r < h && s->b == 32 && v)
+                enfpdif(row, (const float *) q, x, w, s->c);
 
-    for (int j = 0; j < s->r && i + j < n; ++j)
-        enhdif(bin + j * d, n, s->c, s->b);
+            else if (r < h)
+            {
+                if (raw)
+                    memcpy(row, q, (size_t) e);
+                else
+                    ftob(row, (const float *) q,
+                              (size_t) (w * s->c), s->b, s->g);
+
+                memset(row + e, 0, (size_t) (d - e));
+                if (v)
+                    enhdif(row, x, s->c, s->b);
+            }
+            else memset(row, 0, (size_t) d);
+
+            ok = codec_put(&u, row, (size_t) d, r == y - 1);
+        }
+
+        size_t t = codec_end_enc(&u);
+
+        if (ok)
+            *c = (uint32_t) t;
+    }
+    return ok ? m : 0;
 }
 
-void fromdif(scm *s, uint8_t *bin, int i)
+// Decode strip or tile k from the zip buffer of length c, compressed by scheme
+// z with predictor v, to page dat. Each row is decompressed, undifferenced, and
+// converted to floating point in turn, or copied as is if raw is set. Rows of
+// padding below the page are not decompressed. Return false if the strip is
+// corrupt or truncated.
+
+bool fromstrip(scm *s, uint8_t *row, void *dat, bool raw, int k,
+                                     const uint8_t *zip, uint32_t c,
+                                     int z, int v)
 {
     const int n = s->n + 2;
-    const int d = s->c * s->b * n / 8;
+    int i, j, h, w, x, y;
+
+    strip_rect(s, k, &i, &j, &h, &w, &x, &y);
 
-    for (int j = 0; j < s->r && i + j < n; ++j)
-        dehdif(bin + j * d, n, s->c, s->b);
+    const int d = s->c * s->b * x / 8;
+    const int e = s->c * s->b * w / 8;
+
+    const size_t a = raw ? (size_t) s->b / 8 : sizeof (float);
+
+    bool  ok = false;
+    codec u;
+
+    if (codec_dec(&u, getctx(s, k), z, zip, (size_t) c))
+    {
+        ok = true;
+
+        for (int r = 0; r < h; ++r)
+        {
+            uint8_t *q = (uint8_t *) dat
+                       + (size_t) (((i + r) * n + j) * s->c) * a;
+
+            if (!(ok = codec_get(&u, row, (size_t) d)))
+                break;
+
+            if (v == 3)
+                defpdif(row, (float *) q, x, w, s->c);
+            else
+            {
+                if (v == 2)
+                    dehdif(row, w, s->c, s->b);
+                if (raw)
+                    memcpy(q, row, (size_t) e);
+                else
+                    btof(row, (float *) q, (size_t) (w * s->c), s->b, s->g);
+            }
+        }
+        codec_end_dec(&u);
+    }
+    return ok;
 }
 
-// Compress or decompress rows i through i+r.
+// Determine whether all samples of page dat are equal. If so, encode its one
+// pixel to pix and return true. The page is compared with itself offset by one
+// pixel, which matches only if every pixel matches its neighbor. Samples are
+// compared bitwise, so float pages that would convert to a constant native page
+// may be missed, but none is found constant in error.
 
-void tozip(scm *s, uint8_t *bin, int i, uint8_t *zip, uint32_t *c)
+bool topixel(scm *s, uint8_t *pix, const void *dat, bool raw)
 {
-    uLong l = (uLong) ((s->n + 2) * min(s->r, s->n + 2 - i) * s->c * s->b / 8);
-    uLong z = compressBound(l);
+    const size_t a = raw ? (size_t) s->b / 8 : sizeof (float);
+    const size_t e = (size_t) s->c * a;
+    const size_t m = (size_t) (s->n + 2) * (size_t) (s->n + 2);
+
+    const uint8_t *p = (const uint8_t *) dat;
 
-    compress((Bytef *) zip, &z, (const Bytef *) bin, l);
-    *c = (uint32_t) z;
+    if (memcmp(p, p + e, (m - 1) * e) == 0)
+    {
+        if (raw)
+            memcpy(pix, p, e);
+        else
+            ftob(pix, (const float *) p, (size_t) s->c, s->b, s->g);
+
+        return true;
+    }
+    return false;
 }
 
-void fromzip(scm *s, uint8_t *bin, int i, uint8_t *zip, uint32_t c)
+// Fill the columns x0 through x1 - 1 of rows y0 through y1 - 1 of page dat with
+// the encoded pixel pix. The first row is filled pixel by pixel, and the rest
+// are copied from it.
+
+void frompixel(scm *s, void *dat, bool raw, const uint8_t *pix,
+                                  int x0, int y0, int x1, int y1)
 {
-    uLong l = (uLong) ((s->n + 2) * min(s->r, s->n + 2 - i) * s->c * s->b / 8);
-    uLong z = (uLong) c;
+    const int n = s->n + 2;
+
+    const size_t a = raw ? (size_t) s->b / 8 : sizeof (float);
+    const size_t e = (size_t) s->c * a;
+    const size_t w = (size_t) (x1 - x0) * e;
+
+    float v[8];                 // A pixel has at most 64 bits, thus 8 channels.
 
-    uncompress((Bytef *) bin, &l, (const Bytef *) zip, z);
+    if (raw)
+        memcpy(v, pix, e);
+    else
+        btof(pix, v, (size_t) s->c, s->b, s->g);
+
+    if (x0 < x1 && y0 < y1)
+    {
+        uint8_t *p = (uint8_t *) dat + (size_t) ((y0 * n + x0) * s->c) * a;
+
+        for (int j = x0; j < x1; ++j)
+            memcpy(p + (size_t) (j - x0) * e, v, e);
+
+        for (int i = y0 + 1; i < y1; ++i)
+            memcpy(p + (size_t) ((i - y0) * n * s->c) * a, p, w);
+    }
 }
 
 //------------------------------------------------------------------------------
@@ -19,12 +19,15 @@
 //------------------------------------------------------------------------------
 // The following structures define the format of an SCM TIFF: a BigTIFF with a
 // specific set of fields in each IFD. LibTIFF4 has no trouble handling this,
-// Though our usage of 0x129 PageNumber is non-standard.
+// Though our usage of 0x129 PageNumber is non-standard. The exception is a file
+// written with constant pages enabled, as LibTIFF can't decode its uniform
+// pages. See SCM_COMPRESS_CONST below.
 
 typedef struct header header;
 typedef struct field  field;
 typedef struct hfd    hfd;
 typedef struct ifd    ifd;
+typedef struct tfd    tfd;
 
 #define SCM_HFD_COUNT    13
 #define SCM_IFD_COUNT    14
@@ -96,39 +99,161 @@ struct ifd
     uint64_t next;
 };
 
+// A tiled page replaces the strip fields of an IFD with tile fields, and omits
+// the planar configuration, which defaults to chunky. It has the same size and
+// field count as a stripped page, so its next field lies at the same offset.
+
+struct tfd
+{
+    uint64_t count;
+
+    field image_width;          // 0x0100
+    field image_length;         // 0x0101
+    field bits_per_sample;      // 0x0102
+    field compression;          // 0x0103
+    field interpretation;       // 0x0106
+    field orientation;          // 0x0112
+    field samples_per_pixel;    // 0x0115
+    field page_number;          // 0x0129
+    field predictor;            // 0x013D
+    field tile_width;           // 0x0142
+    field tile_length;          // 0x0143
+    field tile_offsets;         // 0x0144
+    field tile_byte_counts;     // 0x0145
+    field sample_format;        // 0x0153
+
+    uint64_t next;
+};
+
 #pragma pack(pop)
 
 //------------------------------------------------------------------------------
 
 typedef struct { long long x; long long o; } scm_pair;
 
+// SCM TIFF I/O back ends. Buffered stdio shares one file position, so reads
+// must be serialized. Positional I/O on a raw file descriptor is stateless and
+// permits concurrent page reads from a single SCM. A read-only memory mapping
+// is also stateless, and lets compressed strips be decoded in place.
+
+#define SCM_IO_STDIO 0
+#define SCM_IO_PREAD 1
+#define SCM_IO_MMAP  2
+
+// Default rows per strip of new SCM TIFF files.
+
+#define SCM_DEFAULT_ROWS 16
+
+// SCM TIFF compression schemes, given as TIFF compression tag values. LZ4 has
+// no registered value, so it takes one from the private range used by SCM TIFF
+// tags. A negative level selects the default of each scheme. The adaptive level
+// chooses per page among storing, the fast level, and the default level.
+
+// If enabled, a page whose samples are all equal is given the private constant
+// scheme in place of any other. Its single strip holds just the one pixel, in
+// spite of its rows-per-strip and image length. This breaks compatibility with
+// LibTIFF, which reports such a page unreadable, so it must be requested. The
+// strip offset and byte count fields locate the pixel directly, so LibTIFF may
+// still read it raw, as scmjpeg does.
+
+#define SCM_COMPRESS_NONE    1
+#define SCM_COMPRESS_DEFLATE 8
+#define SCM_COMPRESS_ZSTD    50000
+#define SCM_COMPRESS_LZ4     0xFFB5
+#define SCM_COMPRESS_CONST   0xFFB6
+
+#define SCM_DEFAULT_LEVEL  -1
+#define SCM_ADAPTIVE_LEVEL -2
+#define SCM_FAST_LEVEL      1
+
+// Adaptive compression outcomes, used to index the page encoding statistics.
+// Constant pages are counted apart from the outcomes of any scheme.
+
+#define SCM_CODE_STORE 0
+#define SCM_CODE_FAST  1
+#define SCM_CODE_FULL  2
+#define SCM_CODE_CONST 3
+
+// SCM TIFF access pattern hints.
+
+#define SCM_ACCESS_NORMAL     0
+#define SCM_ACCESS_SEQUENTIAL 1
+#define SCM_ACCESS_RANDOM     2
+
 struct scm
 {
     char *name;                 // File name
     FILE *fp;                   // PILE pointer
+    int   fd;                   // File descriptor
+    int   io;                   // I/O back end
+
+    long long at;               // File position for positional I/O
+
+    uint8_t  *mp;               // Memory-mapped file pointer
+    long long ml;               // Memory-mapped file length
 
     int n;                      // Page sample count
     int c;                      // Sample channel count
     int b;                      // Channel bit count
-    int g;                      // Channel signed flag
+    int g;                      // Channel signed flag, or 2 if half float
     int r;                      // Rows per strip
+    int t;                      // Tile size, or zero if stripped
+    int z;                      // Compression scheme of new pages
+    int l;                      // Compression level of new pages
+    int u;                      // Store uniform new pages as one pixel
+
+    long long codn[4];          // Pages encoded by each adaptive outcome
+    long long codr[4];          // Uncompressed bytes of each outcome
+    long long codz[4];          // Compressed bytes of each outcome
 
     long long  xc;
     long long *xv;
     long long  oc;
     long long *ov;
-
-    uint8_t **binv;             // Strip bin scratch buffer pointers
+    void      *xm;              // Mapping of the catalog indices, or NULL
+    size_t     xl;              // Length of the mapping of the indices
+    void      *om;              // Mapping of the catalog offsets, or NULL
+    size_t     ol;              // Length of the mapping of the offsets
+    long long *ev;              // Catalog indices in Eytzinger order
+    long long *ei;              // Catalog entry of each Eytzinger node
+    long long  en;              // Count of Eytzinger nodes
+
+    uint8_t **rowv;             // Strip row scratch buffer pointers
     uint8_t **zipv;             // Strip zip scratch buffer pointers
+    struct scm_ctx **ctxv;      // Strip codec context pointers
+    uint8_t **zipp;             // Strip zip data pointers, possibly resident
+    uint64_t *zipo;             // Strip offset array
+    uint32_t *zipl;             // Strip length array
+
+    uint8_t  *stgv;             // Page extent staging buffer
+    size_t    stgz;             // Page extent staging buffer size
+    long long stgo;             // File offset of the staged extent
+    size_t    stgl;             // Length of the staged extent
+    size_t    span;             // Length of the last page extent read
+
+    struct scm       *base;     // SCM shadowed by this reader, if any
+    struct scm_queue *wq;       // Write-behind queue, if any
+    struct scm_pool  *rq;       // Asynchronous read pool, if any
+    struct scm_cache *cache;    // Decoded page cache, if any
+    struct scm_rank  *rk;       // Catalog presence bitmap, if any
 };
 
 typedef struct scm scm;
 
+// Asynchronous read completion callback, given the SCM, the page offset, the
+// page buffer, success flag, and user data.
+
+typedef void (*scm_read_fn)(scm *, long long, float *, bool, void *);
+
 //------------------------------------------------------------------------------
 
 bool is_header(header *);
 bool is_hfd   (hfd *);
 bool is_ifd   (ifd *);
+bool is_tfd   (tfd *);
+
+void scm_tile_ifd  (tfd *, const ifd *, int);
+void scm_untile_ifd(ifd *, const tfd *);
 
 //------------------------------------------------------------------------------
 
@@ -138,23 +263,57 @@ uint64_t scm_pint(scm *);
 uint16_t scm_form(scm *);
 uint16_t scm_type(scm *);
 uint64_t scm_hdif(scm *);
+int      scm_strips(scm *);
+size_t   scm_row_size(scm *);
+size_t   scm_strip_size(scm *);
+size_t   scm_page_size(scm *, bool);
+size_t   scm_zip_size(scm *);
+bool     scm_codec(int);
 
 //------------------------------------------------------------------------------
 
 void ftob(void *, const float *, size_t, int, int);
 void btof(const void *, float *, size_t, int, int);
 
+void ftob_scalar(void *, const float *, size_t, int, int);
+void btof_scalar(const void *, float *, size_t, int, int);
+
 void enhdif(void *, int, int, int);
 void dehdif(void *, int, int, int);
 
-void   tobin(scm *, uint8_t *, const float *, int);
-void frombin(scm *, const uint8_t *, float *, int);
+void enfpdif(uint8_t *, const float *, int, int, int);
+void defpdif(uint8_t *,       float *, int, int, int);
+
+void enhdif_scalar(void *, int, int, int);
+void dehdif_scalar(void *, int, int, int);
+
+size_t   tostrip(scm *, uint8_t *, const void *, bool, int,
+                 uint8_t *, uint32_t *, int, int);
+bool   fromstrip(scm *, uint8_t *, void *, bool, int,
+                 const uint8_t *, uint32_t, int, int);
+void     freectx(struct scm_ctx *);
+
+bool     topixel(scm *, uint8_t *, const void *, bool);
+void   frompixel(scm *, void *, bool, const uint8_t *, int, int, int, int);
+
+//------------------------------------------------------------------------------
+
+// SIMD instruction sets, in order of increasing capability.
+
+#define SCM_SIMD_SCALAR 0
+#define SCM_SIMD_SSE2   1
+#define SCM_SIMD_AVX2   2
+#define SCM_SIMD_AVX512 3
+
+int  scm_simd_detect(void);
+int  scm_simd_level (void);
+void scm_simd_select(int);
 
-void   todif(scm *s, uint8_t *, int);
-void fromdif(scm *s, uint8_t *, int);
+bool ftob_simd(void *, const float *, size_t, int, int);
+bool btof_simd(const void *, float *, size_t, int, int);
 
-void   tozip(scm *, uint8_t *, int, uint8_t *, uint32_t *);
-void fromzip(scm *, uint8_t *, int, uint8_t *, uint32_t);
+bool enhdif_simd(void *, int, int, int);
+bool dehdif_simd(void *, int, int, int);
 
 //------------------------------------------------------------------------------
 
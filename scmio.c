@@ -10,11 +10,28 @@
 // FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License for
 // more details.
 
+#ifndef _WIN32
+#define _POSIX_C_SOURCE 200809L
+#endif
+
+#include <stddef.h>
 #include <string.h>
 #include <stdlib.h>
 #include <assert.h>
 #include <stdio.h>
-#include <zlib.h>
+#include <errno.h>
+
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+
+#ifndef _WIN32
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <pthread.h>
+#include <unistd.h>
+#include <fcntl.h>
+#endif
 
 #include "scmdat.h"
 #include "scmio.h"
@@ -23,22 +40,27 @@
 
 //------------------------------------------------------------------------------
 
-// Allocate properly-sized bin and zip scratch buffers for SCM s.
+// Allocate properly-sized row and zip scratch buffers for SCM s, along with
+// strip pointer, offset, length, and codec context arrays sized by its strip or
+// tile count.
 
 bool scm_alloc(scm *s)
 {
-    size_t bs = (size_t) s->r * (size_t) (s->n + 2)
-              * (size_t) s->c * (size_t)  s->b / 8;
-    size_t zs = compressBound(bs);
+    size_t rs = scm_row_size(s);
+    size_t zs = scm_zip_size(s);
 
-    size_t c = (size_t) (s->n + 2 + s->r - 1) / (size_t) s->r;
+    size_t c = (size_t) scm_strips(s);
 
-    if ((s->binv = (uint8_t **) calloc(c, sizeof (uint8_t *))) &&
-        (s->zipv = (uint8_t **) calloc(c, sizeof (uint8_t *))))
+    if ((s->rowv = (uint8_t **) calloc(c, sizeof (uint8_t *))) &&
+        (s->zipv = (uint8_t **) calloc(c, sizeof (uint8_t *))) &&
+        (s->zipp = (uint8_t **) calloc(c, sizeof (uint8_t *))) &&
+        (s->zipo = (uint64_t *) calloc(c, sizeof (uint64_t)))  &&
+        (s->zipl = (uint32_t *) calloc(c, sizeof (uint32_t)))  &&
+        (s->ctxv = (struct scm_ctx **) calloc(c, sizeof (struct scm_ctx *))))
     {
         for (size_t i = 0; i < c; i++)
         {
-            s->binv[i] = (uint8_t *) malloc(bs);
+            s->rowv[i] = (uint8_t *) malloc(rs);
             s->zipv[i] = (uint8_t *) malloc(zs);
         }
         return true;
@@ -46,25 +68,85 @@ bool scm_alloc(scm *s)
     return false;
 }
 
-// Free the bin and zip scratch buffers.
+// Free the row and zip scratch buffers and the codec contexts.
 
 void scm_free(scm *s)
 {
     if (s->r)
     {
-        int c = (s->n + 2 + s->r - 1) / s->r;
+        int c = scm_strips(s);
 
         for (int i = 0; i < c; i++)
         {
             if (s->zipv) free(s->zipv[i]);
-            if (s->binv) free(s->binv[i]);
+            if (s->rowv) free(s->rowv[i]);
+            if (s->ctxv) freectx(s->ctxv[i]);
         }
     }
+    free(s->ctxv);
+    free(s->zipl);
+    free(s->zipo);
+    free(s->zipp);
     free(s->zipv);
-    free(s->binv);
+    free(s->rowv);
+    free(s->stgv);
 
+    s->ctxv = NULL;
+    s->zipl = NULL;
+    s->zipo = NULL;
+    s->zipp = NULL;
     s->zipv = NULL;
-    s->binv = NULL;
+    s->rowv = NULL;
+    s->stgv = NULL;
+    s->stgz = 0;
+    s->stgl = 0;
+}
+
+// Initialize t as a shadow of SCM s. The shadow shares the file, catalog, page
+// cache, and write-behind queue of s, but owns its scratch buffers and staging
+// buffer, and under stdio its own file pointer. Shadows of one SCM may thus be
+// read concurrently, each by a single thread.
+
+bool scm_shadow(scm *t, scm *s)
+{
+    *t = *s;
+
+    t->base = s;
+    t->fp   = NULL;
+    t->rq   = NULL;
+    t->rowv = NULL;
+    t->zipv = NULL;
+    t->zipp = NULL;
+    t->zipo = NULL;
+    t->zipl = NULL;
+    t->ctxv = NULL;
+    t->stgv = NULL;
+    t->stgz = 0;
+    t->stgl = 0;
+
+    if (s->fp && (t->fp = fopen(s->name, "rb")) == NULL)
+    {
+        syserr("Failed to open %s", s->name);
+        return false;
+    }
+    if (scm_alloc(t))
+    {
+        return true;
+    }
+    scm_unshadow(t);
+    return false;
+}
+
+// Release the resources owned by shadow SCM t.
+
+void scm_unshadow(scm *t)
+{
+    if (t->fp)
+        fclose(t->fp);
+
+    t->fp = NULL;
+
+    scm_free(t);
 }
 
 //------------------------------------------------------------------------------
@@ -74,10 +156,118 @@ void scm_free(scm *s)
 #define ftello _ftelli64
 #endif
 
+// Open the named file using the I/O back end selected by s->io. The mode is
+// given as to fopen: "r+b" to update an existing file or "w+b" to create one.
+// A memory-mapped file is read-only and must already exist. Neither positional
+// nor mapped I/O is implemented under Windows, where stdio is used instead.
+
+bool scm_fopen(scm *s, const char *name, const char *mode)
+{
+#ifndef _WIN32
+    if (s->io == SCM_IO_MMAP)
+    {
+        struct stat st;
+
+        if (mode[0] == 'w')
+        {
+            apperr("%s: Memory-mapped output is not supported", name);
+            return false;
+        }
+        if ((s->fd = open(name, O_RDONLY)) != -1)
+        {
+            if (fstat(s->fd, &st) == 0 && st.st_size > 0)
+            {
+                void *p = mmap(0, (size_t) st.st_size, PROT_READ,
+                                                       MAP_SHARED, s->fd, 0);
+                if (p != MAP_FAILED)
+                {
+                    s->mp = (uint8_t *)  p;
+                    s->ml = (long long) st.st_size;
+                    s->at = 0;
+                    return true;
+                }
+                else syserr("Failed to mmap '%s'", name);
+            }
+        }
+        else syserr("Failed to open '%s'", name);
+        return false;
+    }
+    if (s->io == SCM_IO_PREAD)
+    {
+        int f = (mode[0] == 'w') ? (O_RDWR | O_CREAT | O_TRUNC) : O_RDWR;
+
+        if ((s->fd = open(name, f, 0666)) != -1)
+        {
+            s->at = 0;
+            return true;
+        }
+        syserr("Failed to open '%s'", name);
+        return false;
+    }
+#endif
+    s->io = SCM_IO_STDIO;
+
+    if ((s->fp = fopen(name, mode)))
+        return true;
+
+    syserr("Failed to open '%s'", name);
+    return false;
+}
+
+// Close the file underlying SCM s.
+
+void scm_fclose(scm *s)
+{
+#ifndef _WIN32
+    if (s->mp)
+        munmap(s->mp, (size_t) s->ml);
+    s->mp = NULL;
+    s->ml = 0;
+
+    if (s->io == SCM_IO_PREAD || s->io == SCM_IO_MMAP)
+    {
+        if (s->fd >= 0)
+            close(s->fd);
+        s->fd = -1;
+    }
+#endif
+    if (s->fp)
+        fclose(s->fp);
+    s->fp = NULL;
+}
+
+// Push any buffered output to the file.
+
+void scm_flush(scm *s)
+{
+    if (s->fp)
+        fflush(s->fp);
+}
+
 // Move the SCM file pointer to the end of the file
 
 bool scm_ffwd(scm *s)
 {
+#ifndef _WIN32
+    if (s->io == SCM_IO_MMAP)
+    {
+        s->at = s->ml;
+        return true;
+    }
+    if (s->io == SCM_IO_PREAD)
+    {
+        off_t o;
+
+        if ((o = lseek(s->fd, 0, SEEK_END)) >= 0)
+        {
+            s->at = (long long) o;
+            return true;
+        }
+        else syserr("Failed to seek SCM");
+
+        return false;
+    }
+#endif
     if (fseeko(s->fp, 0, SEEK_END) == 0)
     {
         return true;
@@ -91,6 +281,13 @@ bool scm_ffwd(scm *s)
 
 bool scm_seek(scm *s, long long o)
 {
+#ifndef _WIN32
+    if (s->io == SCM_IO_PREAD || s->io == SCM_IO_MMAP)
+    {
+        s->at = o;
+        return true;
+    }
+#endif
     if (fseeko(s->fp, o, SEEK_SET) == 0)
     {
         return true;
@@ -100,10 +297,79 @@ bool scm_seek(scm *s, long long o)
     return false;
 }
 
+#ifndef _WIN32
+
+// Transfer len bytes at offset o using positional I/O, retrying short counts.
+// Neither function touches the file position, so both may be called from any
+// number of threads at once.
+
+static bool pread_all(int fd, void *ptr, size_t len, long long o)
+{
+    uint8_t *p = (uint8_t *) ptr;
+    ssize_t  n;
+
+    while (len)
+        if ((n = pread(fd, p, len, (off_t) o)) > 0)
+        {
+            p   += n;
+            o   += n;
+            len -= (size_t) n;
+        }
+        else if (n == 0 || errno != EINTR)
+            return false;
+
+    return true;
+}
+
+static bool pwrite_all(int fd, const void *ptr, size_t len, long long o)
+{
+    const uint8_t *p = (const uint8_t *) ptr;
+    ssize_t        n;
+
+    while (len)
+        if ((n = pwrite(fd, p, len, (off_t) o)) > 0)
+        {
+            p   += n;
+            o   += n;
+            len -= (size_t) n;
+        }
+        else if (n == 0 || errno != EINTR)
+            return false;
+
+    return true;
+}
+
+#endif
+
 // Read from the SCM file at the given offset, to the given buffer.
 
 bool scm_read(scm *s, void *ptr, size_t len, long long o)
 {
+#ifndef _WIN32
+    if (s->io == SCM_IO_MMAP)
+    {
+        const uint8_t *p;
+
+        if ((p = scm_mapped(s, len, o)))
+        {
+            memcpy(ptr, p, len);
+            return true;
+        }
+        else apperr("Failed to read SCM: %lld is out of range", o);
+
+        return false;
+    }
+    if (s->io == SCM_IO_PREAD)
+    {
+        if (pread_all(s->fd, ptr, len, o))
+        {
+            return true;
+        }
+        else syserr("Failed to read SCM");
+
+        return false;
+    }
+#endif
     if (scm_seek(s, o))
     {
         if (fread(ptr, 1, len, s->fp) == len)
@@ -117,13 +383,76 @@ bool scm_read(scm *s, void *ptr, size_t len, long long o)
     return false;
 }
 
+// Read up to len bytes from the SCM file at the given offset. A short count is
+// not an error, as the request may overhang the end of the file. Return the
+// number of bytes read, or zero on failure.
+
+static size_t scm_read_some(scm *s, void *ptr, size_t len, long long o)
+{
+    size_t c = 0;
+
+#ifndef _WIN32
+    if (s->io == SCM_IO_MMAP)
+    {
+        if (s->mp && 0 <= o && o < s->ml)
+        {
+            c = (size_t) min((long long) len, s->ml - o);
+            memcpy(ptr, s->mp + o, c);
+        }
+        else apperr("Failed to read SCM: %lld is out of range", o);
+
+        return c;
+    }
+    if (s->io == SCM_IO_PREAD)
+    {
+        uint8_t *p = (uint8_t *) ptr;
+        ssize_t  n;
+
+        while (c < len)
+            if ((n = pread(s->fd, p + c, len - c, (off_t) (o + c))) > 0)
+                c += (size_t) n;
+            else if (n == 0 || errno != EINTR)
+                break;
+
+        if (c == 0) syserr("Failed to read SCM");
+        return c;
+    }
+#endif
+    if (scm_seek(s, o))
+    {
+        if ((c = fread(ptr, 1, len, s->fp)) == 0)
+            syserr("Failed to read SCM");
+    }
+    return c;
+}
+
 // Write the given buffer to the SCM file, returning the offset of the beginning
-// of the write.
+// of the write. Any staged page extent is discarded, as it may now be stale.
 
 long long scm_write(scm *s, const void *ptr, size_t len)
 {
     long long o;
 
+    s->stgl = 0;
+
+#ifndef _WIN32
+    if (s->io == SCM_IO_MMAP)
+    {
+        apperr("Failed to write SCM: file is mapped read-only");
+        return -1;
+    }
+    if (s->io == SCM_IO_PREAD)
+    {
+        if (pwrite_all(s->fd, ptr, len, (o = s->at)))
+        {
+            s->at += (long long) len;
+            return o;
+        }
+        else syserr("Failed to write SCM");
+
+        return -1;
+    }
+#endif
     if ((o = ftello(s->fp)) >= 0)
     {
         if (fwrite(ptr, 1, len, s->fp) == len)
@@ -137,29 +466,157 @@ long long scm_write(scm *s, const void *ptr, size_t len)
     return -1;
 }
 
-// Ensure that the current SCM TIFF position falls on a TIFF word boundary by
-// writing a single byte if the current file offset is odd.
+// Write the given buffer to the SCM file at offset o. Under positional I/O the
+// file position is left alone, so the write-behind thread may use this while
+// the caller's thread continues to read.
+
+bool scm_write_at(scm *s, const void *ptr, size_t len, long long o)
+{
+#ifndef _WIN32
+    if (s->io == SCM_IO_PREAD)
+    {
+        // The write-behind thread never touches the staging buffer.
+
+        if (s->wq == NULL)
+            s->stgl = 0;
+
+        if (pwrite_all(s->fd, ptr, len, o))
+        {
+            return true;
+        }
+        else syserr("Failed to write SCM");
+
+        return false;
+    }
+#endif
+    if (scm_seek(s, o))
+    {
+        return (scm_write(s, ptr, len) >= 0);
+    }
+    return false;
+}
+
+// Ensure that the current SCM TIFF position falls on a multiple of n bytes, up
+// to 16, by writing zeros. TIFF words require n = 2. Return the new position.
 
-long long scm_align(scm *s)
+long long scm_align(scm *s, int n)
 {
-    char  c = 0;
+    static const char z[16] = { 0 };
+
     long long o;
 
-    if ((o = ftello(s->fp)) >= 0)
+#ifndef _WIN32
+    if (s->io == SCM_IO_PREAD || s->io == SCM_IO_MMAP)
+        o = s->at;
+    else
+#endif
+    if ((o = ftello(s->fp)) < 0)
+    {
+        syserr("Failed to tell SCM");
+        return -1;
+    }
+
+    const size_t k = (size_t) ((n - o % n) % n);
+
+    if (k == 0 || scm_write(s, z, k) >= 0)
     {
-        if ((o & 1))
+        return o + (long long) k;
+    }
+    else syserr("Failed to align SCM");
+
+    return -1;
+}
+
+// Map len bytes at offset o of the file of SCM s, privately and writably. The
+// pages of a private mapping are shared with the page cache, and thus with any
+// other process mapping the same file, until they are written, whereupon they
+// are copied. The file itself is never modified. Return a pointer to the bytes
+// and note the mapping in m and l for scm_unmap. Return NULL if the range can't
+// be mapped, as under Windows, in which case the caller must read it instead.
+
+void *scm_map(scm *s, size_t len, long long o, void **m, size_t *l)
+{
+#ifndef _WIN32
+    const long long a = (long long) sysconf(_SC_PAGESIZE);
+    const long long b = o - o % a;
+
+    const int fd = (s->io == SCM_IO_STDIO) ? fileno(s->fp) : s->fd;
+
+    struct stat st;
+    void       *p;
+
+    scm_flush(s);
+
+    if (a > 0 && len && fstat(fd, &st) == 0
+              && o + (long long) len <= (long long) st.st_size)
+    {
+        const size_t n = len + (size_t) (o - b);
+
+        if ((p = mmap(0, n, PROT_READ | PROT_WRITE,
+                            MAP_PRIVATE, fd, (off_t) b)) != MAP_FAILED)
         {
-            if (fwrite(&c, 1, 1, s->fp) == 1)
-            {
-                return o + 1;
-            }
-            else syserr("Failed to align SCM");
+            *m = p;
+            *l = n;
+            return (uint8_t *) p + (o - b);
         }
-        return o;
     }
-    else syserr("Failed to tell SCM");
+#endif
+    return NULL;
+}
 
-    return -1;
+// Release a mapping made by scm_map.
+
+void scm_unmap(void *m, size_t l)
+{
+#ifndef _WIN32
+    if (m)
+        munmap(m, l);
+#endif
+}
+
+// If SCM s is memory-mapped, return a pointer to the len bytes at offset o of
+// the mapping. Return NULL if the file is not mapped or the range exceeds it.
+
+const uint8_t *scm_mapped(scm *s, size_t len, long long o)
+{
+    if (s->mp && 0 <= o && o + (long long) len <= s->ml)
+        return s->mp + o;
+    else
+        return NULL;
+}
+
+// Return a pointer to the len bytes at offset o if they are already resident,
+// either in the memory mapping or in the staged page extent, or NULL if not.
+
+static const uint8_t *scm_resident(scm *s, size_t len, long long o)
+{
+    if (s->mp)
+        return scm_mapped(s, len, o);
+
+    if (s->stgl && s->stgo <= o && o + (long long) len <= s->stgo
+                                           + (long long) s->stgl)
+        return s->stgv + (o - s->stgo);
+
+    return NULL;
+}
+
+// Ensure the staging buffer can hold at least len bytes, preserving content.
+
+static bool scm_stage_alloc(scm *s, size_t len)
+{
+    uint8_t *p;
+
+    if (s->stgz < len)
+    {
+        if ((p = (uint8_t *) realloc(s->stgv, len)) == NULL)
+        {
+            apperr("Failed to allocate SCM staging buffer");
+            return false;
+        }
+        s->stgv = p;
+        s->stgz = len;
+    }
+    return true;
 }
 
 //------------------------------------------------------------------------------
@@ -289,9 +746,9 @@ long long scm_write_hfd(scm *s, hfd *d, long long o)
 
     if (o)
     {
-        if (scm_seek(s, o))
+        if (scm_write_at(s, d, sizeof (hfd), o))
         {
-            return scm_write(s, d, sizeof (hfd));
+            return o;
         }
         else return -1;
     }
@@ -316,7 +773,7 @@ bool scm_init_ifd(scm *s, ifd *d)
         scm_field(&d->rows_per_strip,    0x0116, 3, 1, (uint64_t) s->r);
         scm_field(&d->interpretation,    0x0106, 3, 1, scm_pint(s));
         scm_field(&d->predictor,         0x013D, 3, 1, scm_hdif(s));
-        scm_field(&d->compression,       0x0103, 3, 1, 8);
+        scm_field(&d->compression,       0x0103, 3, 1, (uint64_t) s->z);
         scm_field(&d->orientation,       0x0112, 3, 1, 2);
         scm_field(&d->configuration,     0x011C, 3, 1, 1);
         scm_field(&d->bits_per_sample,   0x0102, 3, c, 0);
@@ -341,6 +798,28 @@ bool scm_init_ifd(scm *s, ifd *d)
     return false;
 }
 
+// Copy the IFD at p to d. If it describes a tiled page, convert it to the
+// stripped form, with tile offsets and byte counts in place of those of strips.
+
+static bool scm_load_ifd(ifd *d, const void *p)
+{
+    tfd t;
+
+    memcpy(d, p, sizeof (ifd));
+
+    if (is_ifd(d))
+        return true;
+
+    memcpy(&t, p, sizeof (tfd));
+
+    if (is_tfd(&t))
+    {
+        scm_untile_ifd(d, &t);
+        return true;
+    }
+    return false;
+}
+
 // Read an IFD at offset o of SCM TIFF s.
 
 bool scm_read_ifd(scm *s, ifd *d, long long o)
@@ -348,9 +827,11 @@ bool scm_read_ifd(scm *s, ifd *d, long long o)
     assert(s);
     assert(d);
 
-    if (o && scm_read(s, d, sizeof (ifd), o))
+    ifd e;
+
+    if (o && scm_read(s, &e, sizeof (ifd), o))
     {
-        if (is_ifd(d))
+        if (scm_load_ifd(d, &e))
         {
             return true;
         }
@@ -367,36 +848,149 @@ long long scm_write_ifd(scm *s, ifd *d, long long o)
     assert(s);
     assert(d);
 
+    tfd t;
+
+    if (s->t)
+    {
+        scm_tile_ifd(&t, d, s->t);
+        d = (ifd *) &t;
+    }
+
     if (o)
     {
-        if (scm_seek(s, o))
+        if (scm_write_at(s, d, sizeof (ifd), o))
         {
-            return scm_write(s, d, sizeof (ifd));
+            return o;
         }
         else return -1;
     }
     else return scm_write(s, d, sizeof (ifd));
 }
 
-//------------------------------------------------------------------------------
+// Return the worst-case length of a page extent of sc strips: the IFD, the
+// compressed strips, their offset and length arrays, and a pad byte.
 
-// Read the header and the HFD and determine basic image parameters from it:
-// the image size, channel count, bits-per-sample, and sample format.
+static size_t scm_extent_bound(scm *s, long long sc)
+{
+    return sizeof (ifd) + 2 + (size_t) sc * (scm_zip_size(s) + 12);
+}
 
-bool scm_read_preamble(scm *s)
+// Read the IFD at offset o of SCM TIFF s. scm_append writes each page as one
+// contiguous extent: the IFD, the strips, then the strip offset and byte count
+// arrays. If the IFD describes such a layout, read the entire extent into the
+// staging buffer so that the page may be decoded without further I/O. The
+// length of the previous extent is used to guess the length of this one, so a
+// page is usually fetched with a single read. Files with a different layout
+// fall back to the IFD alone, and the strips are read individually.
+
+bool scm_stage_ifd(scm *s, ifd *d, long long o)
 {
-    header h;
-    hfd    d;
+    assert(s);
+    assert(d);
 
-    if (scm_read_header(s, &h))
+    if (s->mp)
+        return scm_read_ifd(s, d, o);
+
+    size_t g = max(s->span, sizeof (ifd));
+    size_t c;
+
+    s->stgl = 0;
+
+    if (o && scm_stage_alloc(s, g) && (c = scm_read_some(s, s->stgv, g, o)))
     {
-        if (scm_read_hfd(s, &d, h.first_ifd))
+        if (c >= sizeof (ifd))
         {
-            s->n = (int)                 d.image_width      .offset - 2;
-            s->c = (int)                 d.samples_per_pixel.offset;
-            s->r = (int)                 d.rows_per_strip   .offset;
-            s->b = (int) ((uint16_t *) (&d.bits_per_sample  .offset))[0];
-            s->g = (2 == ((uint16_t *) (&d.sample_format    .offset))[0]);
+            if (scm_load_ifd(d, s->stgv))
+            {
+                const long long oo = (long long) d->strip_offsets.offset;
+                const long long lo = (long long) d->strip_byte_counts.offset;
+                const long long sc = (long long) d->strip_byte_counts.count;
+
+                // Bound the extent by the worst-case compressed page size. A
+                // constant page ends with its one strip, given by the fields.
+
+                const long long m = (long long) scm_extent_bound(s, sc);
+
+                const bool k = (d->compression.offset == SCM_COMPRESS_CONST);
+
+                const long long e = k ? oo + lo : max(oo + sc * 8, lo + sc * 4);
+
+                s->stgo = o;
+                s->stgl = c;
+
+                if (oo > o && (k || lo > o) && e - o <= m)
+                {
+                    const size_t l = (size_t) (e - o);
+
+                    if (l > c)
+                    {
+                        if (scm_stage_alloc(s, l) &&
+                            scm_read(s, s->stgv + c, l - c, o + (long long) c))
+                            s->stgl = l;
+                        else
+                            s->stgl = 0;
+                    }
+                    s->span = l;
+                }
+                else s->span = 0;
+
+                return true;
+            }
+            else apperr("%s is not an SCM TIFF", s->name);
+        }
+        else apperr("Failed to read SCM TIFF IFD");
+    }
+    return false;
+}
+
+//------------------------------------------------------------------------------
+
+// Read the header and the HFD and determine basic image parameters from it:
+// the image size, channel count, bits-per-sample, and sample format. Pages are
+// uniformly stripped or tiled, so check the first page to find the tile size.
+// Also take the compression scheme of new pages from the first page.
+
+bool scm_read_preamble(scm *s)
+{
+    header   h;
+    hfd      d;
+    tfd      t;
+    uint16_t b;
+    uint16_t f;
+
+    if (scm_read_header(s, &h))
+    {
+        if (scm_read_hfd(s, &d, h.first_ifd))
+        {
+            memcpy(&b, &d.bits_per_sample.offset, sizeof (uint16_t));
+            memcpy(&f, &d.sample_format  .offset, sizeof (uint16_t));
+
+            s->n = (int) d.image_width      .offset - 2;
+            s->c = (int) d.samples_per_pixel.offset;
+            s->r = (int) d.rows_per_strip   .offset;
+            s->b = (int) b;
+            s->g = (f == 2);
+
+            // 16-bit floating point samples are half precision.
+
+            if (f == 3 && b == 16)
+                s->g = 2;
+
+            s->z = SCM_COMPRESS_DEFLATE;
+            s->l = SCM_DEFAULT_LEVEL;
+
+            if (d.next && scm_read(s, &t, sizeof (tfd), (long long) d.next))
+            {
+                if (is_tfd(&t))
+                    s->t = (int) t.tile_width.offset;
+
+                // A stored page may be an adaptive outcome, and a constant page
+                // has no true scheme. Don't inherit either.
+
+                if (scm_codec((int) t.compression.offset) &&
+                       (int) t.compression.offset != SCM_COMPRESS_NONE)
+                    s->z = (int) t.compression.offset;
+            }
 
             return true;
         }
@@ -432,166 +1026,1361 @@ bool scm_write_preamble(scm *s)
 
 //------------------------------------------------------------------------------
 
+// Read the strip offset and length arrays of a page into the given arrays.
+
+static bool scm_read_list(scm *s, uint64_t  oo,
+                                  uint64_t  lo,
+                                  uint16_t  sc, uint64_t *o, uint32_t *l)
+{
+    const size_t os = sc * sizeof (uint64_t);
+    const size_t ls = sc * sizeof (uint32_t);
+
+    const uint8_t *p;
+
+    if ((p = scm_resident(s, os, (long long) oo)))
+        memcpy(o, p, os);
+    else if (!scm_read(s, o, os, (long long) oo))
+        return false;
+
+    if ((p = scm_resident(s, ls, (long long) lo)))
+        memcpy(l, p, ls);
+    else if (!scm_read(s, l, ls, (long long) lo))
+        return false;
+
+    return true;
+}
+
+// Read strip i, or point to it if it is already resident.
+
+static bool scm_read_zip(scm *s, uint8_t **zv, const uint64_t *o,
+                                               const uint32_t *l, int i)
+{
+    const uint8_t *p;
+
+    if ((size_t) l[i] > scm_zip_size(s))
+    {
+        apperr("%s: Strip length %u exceeds %u", s->name,
+                (unsigned) l[i], (unsigned) scm_zip_size(s));
+        return false;
+    }
+
+    if ((p = scm_resident(s, (size_t) l[i], (long long) o[i])))
+        zv[i] = (uint8_t *) p;
+    else if (!scm_read(s, zv[i], (size_t) l[i], (long long) o[i]))
+        return false;
+
+    return true;
+}
+
 // Read a page of data into the zip caches. Store the strip offsets and lengths
 // in the given arrays. This is the serial part of the parallel input handler.
-
-bool scm_read_zips(scm *s, uint8_t **zv,
-                           uint64_t  oo,
-                           uint64_t  lo,
-                           uint16_t  sc, uint64_t *o, uint32_t *l)
+// Strips already resident in the memory mapping or the staged page extent are
+// not copied. Instead, the pointers in zv are redirected to them, so zv must
+// not be the SCM's own zipv. As the staging buffer belongs to s, separate
+// readers of one SCM, as given by scm_reader, may run concurrently, but calls
+// upon a single SCM may not.
+
+bool scm_read_zips(scm *s, uint8_t **zv, const ifd *d, uint64_t *o,
+                                                        uint32_t *l)
 {
-    // Read the strip offset and length arrays.
+    uint64_t oo = (uint64_t) d->strip_offsets.offset;
+    uint64_t lo = (uint64_t) d->strip_byte_counts.offset;
+    uint16_t sc = (uint16_t) d->strip_byte_counts.count;
 
-    if (!scm_read(s, o, sc * sizeof (uint64_t), (long long) oo)) return false;
-    if (!scm_read(s, l, sc * sizeof (uint32_t), (long long) lo)) return false;
+    // The one strip of a constant page is located by the fields themselves.
 
-    // Read each strip.
+    if (d->compression.offset == SCM_COMPRESS_CONST && sc == 1)
+    {
+        o[0] =            oo;
+        l[0] = (uint32_t) lo;
+    }
+    else if (!scm_read_list(s, oo, lo, sc, o, l))
+        return false;
 
     for (int i = 0; i < sc; i++)
-        if (!scm_read(s, zv[i], (size_t) l[i], (long long) o[i]))
+        if (!scm_read_zip(s, zv, o, l, i))
             return false;
 
     return true;
 }
 
-// Write a page of data from the zip caches. This is the serial part of the
-// parallel output handler. Also, in concert with scm_read_zips, this function
-// allows data to be copied from one SCM to another without the computational
-// cost of an unnecessary encode-decode cycle.
-
-bool scm_write_zips(scm *s, uint8_t **zv,
-                            uint64_t *oo,
-                            uint64_t *lo,
-                            uint16_t *sc, uint64_t *o, uint32_t *l)
+// Gather the strips of a page into a single contiguous extent to be written at
+// offset o: the IFD, the strips, the strip offset and byte count arrays, and a
+// pad byte if needed to keep the next page word-aligned. Fill the strip fields
+// of IFD d. Return a newly allocated buffer and store its length in len. This
+// is the serial part of the parallel output handler. Also, in concert with
+// scm_read_zips, this function allows data to be copied from one SCM to another
+// without the computational cost of an unnecessary encode-decode cycle. A
+// constant page has no arrays. As TIFF requires of arrays of one, its strip
+// offset and byte count are given by the fields themselves.
+
+uint8_t *scm_pack_zips(scm *s, ifd *d, uint8_t **zv, const uint32_t *l,
+                                   uint16_t sc, long long o, size_t *len)
 {
-    size_t c = (size_t) (*sc);
-    long long t;
+    const bool k = (d->compression.offset == SCM_COMPRESS_CONST && sc == 1);
 
-    // Write each strip to the file, noting all offsets.
+    uint64_t oo;
+    uint64_t lo;
+    uint64_t z;
+    uint8_t *p;
+    size_t   n = sizeof (ifd);
+    size_t   e;
 
-    for (size_t i = 0; i < c; i++)
-        if ((t = scm_write(s, zv[i], (size_t) l[i])) > 0)
-            o[i] = (uint64_t) t;
-        else
-            return false;
+    // Lay out the extent, noting the locations of the arrays.
 
-    // Write the strip offset and length arrays.
+    for (int i = 0; i < sc; i++)
+        n += l[i];
 
-    if ((t = scm_write(s, o, c * sizeof (uint64_t))) > 0)
-        *oo = (uint64_t) t;
+    if (k)
+    {
+        oo = (uint64_t) o + sizeof (ifd);
+        lo = (uint64_t) l[0];
+    }
     else
-        return false;
+    {
+        oo = (uint64_t) o + n; n += sc * sizeof (uint64_t);
+        lo = (uint64_t) o + n; n += sc * sizeof (uint32_t);
+    }
 
-    if ((t = scm_write(s, l, c * sizeof (uint32_t))) > 0)
-        *lo = (uint64_t) t;
-    else
-        return false;
+    if ((o + (long long) (e = n)) & 1)
+        n++;
 
-    return true;
+    scm_field(&d->strip_offsets,     0x0111, 16, sc, oo);
+    scm_field(&d->strip_byte_counts, 0x0117,  4, sc, lo);
+
+    // Gather the IFD, strips, and arrays, noting each strip offset.
+
+    if ((p = (uint8_t *) malloc(n)))
+    {
+        uint8_t *q = p + sizeof (ifd);
+        tfd      t;
+
+        if (s->t)
+        {
+            scm_tile_ifd(&t, d, s->t);
+            memcpy(p, &t, sizeof (tfd));
+        }
+        else
+            memcpy(p, d, sizeof (ifd));
+
+        for (int i = 0; i < sc; i++)
+        {
+            z = (uint64_t) o + (uint64_t) (q - p);
+
+            if (!k)
+                memcpy(p + (oo - (uint64_t) o) + i * sizeof (uint64_t), &z,
+                                                     sizeof (uint64_t));
+            memcpy(q, zv[i], l[i]);
+
+            q += l[i];
+        }
+
+        if (!k)
+            memcpy(p + (lo - (uint64_t) o), l, sc * sizeof (uint32_t));
+
+        if (n > e)
+            p[n - 1] = 0;
+
+        *len = n;
+    }
+    else apperr("Failed to allocate SCM page extent");
+
+    return p;
 }
 
 //------------------------------------------------------------------------------
 
-// Read and decode a page of data to the given float buffer.
+// Determine whether strip or tile i of SCM s intersects the region of columns
+// x0 through x1 - 1 and rows y0 through y1 - 1.
+
+static bool scm_touch(scm *s, int i, int x0, int y0, int x1, int y1)
+{
+    if (s->t)
+    {
+        const int m = (s->n + 2 + s->t - 1) / s->t;
+        const int y = (i / m) * s->t;
+        const int x = (i % m) * s->t;
+
+        return (x < x1 && x0 < x + s->t && y < y1 && y0 < y + s->t);
+    }
+    else
+    {
+        const int y = i * s->r;
+
+        return (y < y1 && y0 < y + s->r);
+    }
+}
+
+// Read the pixel of constant page with IFD d and fill the region of columns x0
+// through x1 - 1 and rows y0 through y1 - 1 of the float or raw buffer p with
+// it.
+
+static bool scm_read_const(scm *s, void *p, bool raw, const ifd *d, int x0,
+                                                     int y0, int x1, int y1)
+{
+    uint16_t sc = (uint16_t) d->strip_byte_counts.count;
+
+    const uint32_t e = (uint32_t) (s->c * s->b / 8);
+
+    uint8_t **z = s->zipp;
+
+    if (sc != 1 || e > sizeof (uint64_t))
+    {
+        apperr("%s: Malformed constant page", s->name);
+        return false;
+    }
+
+    z[0] = s->zipv[0];
+
+    if (scm_read_zips(s, z, d, s->zipo, s->zipl))
+    {
+        if (s->zipl[0] == e)
+        {
+            frompixel(s, p, raw, z[0], x0, y0, x1, y1);
+            return true;
+        }
+        else apperr("%s: Constant page pixel length %u, expected %u",
+                     s->name, (unsigned) s->zipl[0], (unsigned) e);
+    }
+    return false;
+}
 
-bool scm_read_data(scm *s, float *p, uint64_t oo,
-                                     uint64_t lo,
-                                     uint16_t sc)
+// Read and decode the strips or tiles of a page intersecting the region of
+// columns x0 through x1 - 1 and rows y0 through y1 - 1 to the given float
+// buffer, or native-typed buffer if raw is set. Only those strips or tiles are
+// read, and the rest of the page is left untouched. The page's compression
+// scheme and predictor are given by its IFD d.
+
+bool scm_read_part(scm *s, void *p, bool raw, const ifd *d, int x0, int y0,
+                                                             int x1, int y1)
 {
     // Strip count and rows-per-strip are given by the IFD.
 
+    uint64_t oo = (uint64_t) d->strip_offsets.offset;
+    uint64_t lo = (uint64_t) d->strip_byte_counts.offset;
+    uint16_t sc = (uint16_t) d->strip_byte_counts.count;
+    uint16_t cs = (uint16_t) d->compression.offset;
+    uint16_t pd = (uint16_t) d->predictor.offset;
+
     int i, c = sc;
-    uint64_t o[256];
-    uint32_t l[256];
 
-    if (scm_read_zips(s, s->zipv, oo, lo, sc, o, l))
+    uint8_t **z = s->zipp;
+
+    if (cs == SCM_COMPRESS_CONST)
+        return scm_read_const(s, p, raw, d, x0, y0, x1, y1);
+
+    if (c > scm_strips(s))
+    {
+        apperr("%s: Page has %d strips, expected at most %d",
+                s->name, c, scm_strips(s));
+        return false;
+    }
+    if (!scm_codec(cs))
+    {
+        apperr("%s: Unsupported compression scheme %d", s->name, cs);
+        return false;
+    }
+    if (pd != 1 && pd != scm_hdif(s))
+    {
+        apperr("%s: Unsupported predictor %d", s->name, pd);
+        return false;
+    }
+
+    for (i = 0; i < c; i++)
+        z[i] = s->zipv[i];
+
+    if (scm_read_list(s, oo, lo, sc, s->zipo, s->zipl))
     {
-        // Decode each strip.
+        for (i = 0; i < c; i++)
+            if (scm_touch(s, i, x0, y0, x1, y1))
+                if (!scm_read_zip(s, z, s->zipo, s->zipl, i))
+                    return false;
+
+        // Decode each strip or tile.
 
-        #pragma omp parallel for
+        int f = 0;
+
+        #pragma omp parallel for reduction(+:f)
         for (i = 0; i < c; i++)
-        {
-            fromzip(s, s->binv[i],    i * s->r, s->zipv[i], l[i]);
-            fromdif(s, s->binv[i],    i * s->r);
-            frombin(s, s->binv[i], p, i * s->r);
-        }
-        return true;
+            if (scm_touch(s, i, x0, y0, x1, y1))
+                f += !fromstrip(s, s->rowv[i], p, raw, i, z[i], s->zipl[i],
+                                                                   cs, pd);
+        if (f == 0)
+            return true;
+
+        apperr("%s: Failed to decode %d of %d strips", s->name, f, c);
     }
     return false;
 }
 
-// Encode and write a page of data from the given float buffer.
+// Read and decode a page of data to the given float buffer.
+
+bool scm_read_data(scm *s, void *p, bool raw, const ifd *d)
+{
+    return scm_read_part(s, p, raw, d, 0, 0, s->n + 2, s->n + 2);
+}
+
+// Adaptive compression policy. The first strips of each page are encoded at
+// the fast level, and the ratio achieved decides the encoding of the rest. Data
+// that barely compresses, such as noisy deep samples, is stored. Data that
+// compresses poorly or very well gains little beyond the fast level. Only the
+// middle ground is worth the cost of the default level.
+
+#define SCM_SAMPLE_STRIPS 4
+#define SCM_STORE_RATIO   1.1
+#define SCM_FAST_RATIO    1.5
+#define SCM_FLAT_RATIO    4.0
+
+// Encode strips a through b - 1 of float or raw page p using scheme z at level
+// v. Add their total uncompressed length to m. Return false if any fails.
+
+static bool scm_code_strips(scm *s, const void *p, bool raw, uint32_t *l,
+                            int a, int b, int z, int v, long long *m)
+{
+    long long n = 0;
+    int       f = 0;
+    int       i;
+
+    #pragma omp parallel for reduction(+:n, f)
+    for (i = a; i < b; i++)
+    {
+        const size_t k = tostrip(s, s->rowv[i], p, raw, i, s->zipv[i], l + i,
+                                                                       z, v);
+        n += (long long) k;
+        f += (k == 0);
+    }
+    *m += n;
+    return (f == 0);
+}
+
+// Encode a page of data from the given float or raw buffer into the zip scratch
+// buffers. Note the length of each strip, the strip count, and the scheme used,
+// and accumulate the encoding statistics. If enabled, a page of equal samples
+// is given the constant scheme regardless of the scheme of new pages. Return
+// false if any strip fails to encode.
 
-bool scm_write_data(scm *s, const float *p, uint64_t *oo,
-                                            uint64_t *lo,
-                                            uint16_t *sc)
+bool scm_code_data(scm *s, const void *p, bool raw,
+                   uint32_t *l, uint16_t *sc, int *z)
 {
     // Strip count is total rows / rows-per-strip rounded up.
 
-    int i, c = (s->n + 2 + s->r - 1) / s->r;
-    uint64_t o[256];
-    uint32_t l[256];
+    int i, k, c = scm_strips(s), o = SCM_CODE_FULL;
 
-    // Encode each strip for writing. This is our hot spot.
+    long long m = 0;
+    long long n = 0;
 
-    #pragma omp parallel for
-    for (i = 0; i < c; i++)
+    bool ok;
+
+    *z = s->z;
+
+    // A constant page is reduced to its one pixel.
+
+    if (s->u && topixel(s, s->zipv[0], p, raw))
+    {
+        l[0] = (uint32_t) (s->c * s->b / 8);
+
+        s->codn[SCM_CODE_CONST] += 1;
+        s->codr[SCM_CODE_CONST] += (long long) scm_page_size(s, true);
+        s->codz[SCM_CODE_CONST] += (long long) l[0];
+
+        *z  = SCM_COMPRESS_CONST;
+        *sc = 1;
+        return true;
+    }
+
+    // Encode each strip or tile for writing. This is our hot spot.
+
+    if (s->l == SCM_ADAPTIVE_LEVEL && s->z != SCM_COMPRESS_NONE)
+    {
+        // Encode the sample strips at the fast level and gauge the ratio.
+
+        k  = min(c, SCM_SAMPLE_STRIPS);
+        ok = scm_code_strips(s, p, raw, l, 0, k, s->z, SCM_FAST_LEVEL, &m);
+
+        for (i = 0; i < k; i++)
+            n += (long long) l[i];
+
+        const double r = n ? (double) m / (double) n : 0.0;
+
+        if      (r < SCM_STORE_RATIO) o = SCM_CODE_STORE;
+        else if (r < SCM_FAST_RATIO)  o = SCM_CODE_FAST;
+        else if (r > SCM_FLAT_RATIO)  o = SCM_CODE_FAST;
+
+        // Keep the sample strips only if the rest match them.
+
+        if (o == SCM_CODE_STORE)
+            *z = SCM_COMPRESS_NONE;
+
+        if (ok && o == SCM_CODE_FAST)
+            ok = scm_code_strips(s, p, raw, l, k, c, *z, SCM_FAST_LEVEL, &m);
+        else if (ok)
+        {
+            m  = 0;
+            ok = scm_code_strips(s, p, raw, l, 0, c, *z, SCM_DEFAULT_LEVEL, &m);
+        }
+    }
+    else
+    {
+        if (s->z == SCM_COMPRESS_NONE)
+            o = SCM_CODE_STORE;
+
+        ok = scm_code_strips(s, p, raw, l, 0, c, s->z, s->l, &m);
+    }
+
+    if (!ok)
     {
-        tobin(s, s->binv[i], p, i * s->r);
-        todif(s, s->binv[i],    i * s->r);
-        tozip(s, s->binv[i],    i * s->r, s->zipv[i], l + i);
+        apperr("%s: Failed to encode page", s->name);
+        return false;
     }
 
+    for (n = 0, i = 0; i < c; i++)
+        n += (long long) l[i];
+
+    s->codn[o] += 1;
+    s->codr[o] += m;
+    s->codz[o] += n;
+
     *sc = (uint16_t) c;
+    return true;
+}
 
-    return scm_write_zips(s, s->zipv, oo, lo, sc, o, l);
+// Return the page count and the uncompressed and compressed byte counts of the
+// pages of SCM s encoded with adaptive outcome o.
+
+void scm_code_stats(scm *s, int o, long long *n, long long *r, long long *z)
+{
+    *n = s->codn[o];
+    *r = s->codr[o];
+    *z = s->codz[o];
 }
 
 //------------------------------------------------------------------------------
 
 // Set IFD c to be the "next" of IFD p. If p is zero, set IFD c to be the first
-// IFD linked-to by the preamble.
+// IFD linked-to by the preamble. Only the 8-byte next field is written, so no
+// read-back of the previous IFD is needed.
 
 bool scm_link_list(scm *s, long long c, long long p)
 {
+    uint64_t n = (uint64_t) c;
+
     if (p)
     {
-        ifd i;
+        if (scm_write_at(s, &n, sizeof (n), p + offsetof(ifd, next)))
+        {
+            return true;
+        }
+        else apperr("%s: Failed to write previous IFD", s->name);
+    }
+    else
+    {
+        header h;
 
-        if (scm_read_ifd(s, &i, p))
+        if (scm_read_header(s, &h))
         {
-            i.next = (uint64_t) c;
+            long long o = (long long) h.first_ifd;
 
-            if (scm_write_ifd(s, &i, p) > 0)
+            if (scm_write_at(s, &n, sizeof (n), o + offsetof(hfd, next)))
             {
                 return true;
             }
-            else apperr("%s: Failed to write previous IFD", s->name);
+            else apperr("%s: Failed to write preamble", s->name);
         }
-        else apperr("%s: Failed to read previous IFD", s->name);
-   }
-    else
+        else apperr("%s: Failed to read preamble", s->name);
+    }
+    return false;
+}
+
+// Catalog scans read IFDs through a window of this size whenever the pages are
+// packed closely enough for it to span at least this many.
+
+#define SCM_SCAN_WINDOW 262144
+#define SCM_SCAN_PAGES  4
+
+// Walk the IFD list of SCM s from offset o, noting the index and offset of each
+// page as a pair in a newly allocated array v. Return the page count. Appended
+// pages are contiguous extents, each directly following the last, so the
+// distance between one IFD and the next predicts that of those after. When it
+// is small, the IFDs that follow are read along with the current one.
+
+long long scm_scan_list(scm *s, long long o, long long **v)
+{
+    uint8_t  *w = (uint8_t *) malloc(SCM_SCAN_WINDOW);
+    long long a = 0;
+    size_t    l = 0;
+    long long h = 0;
+
+    long long c = 0;
+    long long m = 0;
+
+    const uint8_t *q;
+
+    ifd d;
+
+    v[0] = NULL;
+
+    while (o)
     {
-        header h;
-        hfd    d;
+        const long long e = o + (long long) sizeof (ifd);
 
-        if (scm_read_header(s, &h))
+        // Find the IFD in the mapping or the window, or refill the window.
+
+        if ((q = scm_mapped(s, sizeof (ifd), o)) == NULL && w)
         {
-            if (scm_read_hfd(s, &d, h.first_ifd))
+            if (!(a <= o && e <= a + (long long) l))
             {
-                d.next = (uint64_t) c;
-
-                if (scm_write_hfd(s, &d, h.first_ifd) > 0)
+                if (0 < h && h * SCM_SCAN_PAGES <= SCM_SCAN_WINDOW)
                 {
-                    return true;
+                    l = scm_read_some(s, w, SCM_SCAN_WINDOW, o);
+                    a = o;
                 }
-                else apperr("%s: Failed to write preamble", s->name);
+                else l = 0;
             }
-            else apperr("%s: Failed to read preamble", s->name);
+            if (a <= o && e <= a + (long long) l)
+                q = w + (o - a);
         }
-        else apperr("%s: Failed to read preamble", s->name);
+
+        if (q == NULL && !scm_read_ifd(s, &d, o))
+            break;
+
+        if (q && !scm_load_ifd(&d, q))
+        {
+            apperr("%s is not an SCM TIFF", s->name);
+            break;
+        }
+
+        // Grow the array as needed and note the page.
+
+        if (c == m)
+        {
+            long long *p;
+
+            m = m ? m * 2 : 1024;
+
+            if ((p = (long long *) realloc(v[0], (size_t) m * 2
+                                               * sizeof (long long))) == NULL)
+            {
+                apperr("Failed to allocate SCM catalog");
+                free(v[0]);
+                v[0] = NULL;
+                c    = 0;
+                break;
+            }
+            v[0] = p;
+        }
+
+        v[0][2 * c + 0] = (long long) d.page_number.offset;
+        v[0][2 * c + 1] = o;
+
+        c++;
+
+        h = (long long) d.next - o;
+        o = (long long) d.next;
+    }
+
+    free(w);
+
+    return c;
+}
+
+//------------------------------------------------------------------------------
+
+// Write-behind lets the caller queue encoded page extents and return at once,
+// while a dedicated I/O thread writes them and links their IFDs in order. This
+// overlaps disk output with the encoding and sampling of the next page. The
+// queue is bounded, so a caller that outpaces the disk blocks rather than
+// consuming unbounded memory. Since each extent is fully encoded before it is
+// queued, its offset is known immediately, and pages already written may be
+// read back while later ones are still in flight.
+
+#ifndef _WIN32
+
+struct scm_page
+{
+    long long o;                // Offset of the page extent
+    long long b;                // Offset of the previous IFD
+    uint8_t  *p;                // Page extent buffer
+    size_t    n;                // Page extent length
+};
+
+struct scm_queue
+{
+    pthread_t        thread;
+    pthread_mutex_t  mutex;
+    pthread_cond_t   cond;
+
+    struct scm_page *v;         // Ring buffer of queued pages
+    int              m;         // Ring buffer capacity
+    int              i;         // Index of the first queued page
+    int              c;         // Count of queued pages
+    int              busy;      // I/O thread is writing a page
+    int              stop;      // I/O thread should exit when idle
+    bool             fail;      // A queued write has failed
+
+    long long        tail;      // End of file including all queued pages
+    long long        done;      // End of file as written so far
+};
+
+// Write-behind I/O thread. Write and link each queued page in turn.
+
+static void *scm_queue_main(void *data)
+{
+    scm              *s = (scm *) data;
+    struct scm_queue *q = s->wq;
+    struct scm_page   t;
+
+    pthread_mutex_lock(&q->mutex);
+
+    while (true)
+    {
+        while (q->c == 0 && q->stop == 0)
+            pthread_cond_wait(&q->cond, &q->mutex);
+
+        if (q->c == 0)
+            break;
+
+        t       = q->v[q->i];
+        q->i    = (q->i + 1) % q->m;
+        q->c   -= 1;
+        q->busy = 1;
+
+        pthread_cond_broadcast(&q->cond);
+        pthread_mutex_unlock(&q->mutex);
+
+        bool ok = scm_write_at(s, t.p, t.n, t.o) && scm_link_list(s, t.o, t.b);
+
+        free(t.p);
+
+        pthread_mutex_lock(&q->mutex);
+
+        if (ok)
+            q->done = t.o + (long long) t.n;
+        else
+            q->fail = true;
+
+        q->busy = 0;
+
+        pthread_cond_broadcast(&q->cond);
+    }
+
+    pthread_mutex_unlock(&q->mutex);
+    return NULL;
+}
+
+#endif
+
+// Start a write-behind queue of n pages on SCM s, or if n is zero, stop it after
+// all queued pages are written. The I/O thread writes at explicit offsets, so
+// write-behind requires positional I/O. Return false if a queued write failed
+// or if the queue cannot be started, in which case writes remain synchronous.
+
+bool scm_write_queue_init(scm *s, int n)
+{
+#ifndef _WIN32
+    struct scm_queue *q = s->wq;
+    bool st = true;
+
+    if (q)
+    {
+        pthread_mutex_lock(&q->mutex);
+        q->stop = 1;
+        pthread_cond_broadcast(&q->cond);
+        pthread_mutex_unlock(&q->mutex);
+
+        pthread_join(q->thread, NULL);
+        pthread_cond_destroy(&q->cond);
+        pthread_mutex_destroy(&q->mutex);
+
+        s->at = q->done;
+        s->wq = NULL;
+        st    = !q->fail;
+
+        free(q->v);
+        free(q);
+    }
+
+    if (n > 0)
+    {
+        if (s->io != SCM_IO_PREAD)
+        {
+            apperr("%s: Write-behind requires positional I/O", s->name);
+            return false;
+        }
+        if (scm_ffwd(s) && (q = (struct scm_queue *)
+                                calloc(1, sizeof (struct scm_queue))))
+        {
+            if ((q->v = (struct scm_page *)
+                        calloc((size_t) n, sizeof (struct scm_page))))
+            {
+                q->m    = n;
+                q->tail = s->at;
+                q->done = s->at;
+
+                pthread_mutex_init(&q->mutex, NULL);
+                pthread_cond_init (&q->cond,  NULL);
+
+                s->wq = q;
+
+                if (pthread_create(&q->thread, NULL, scm_queue_main, s) == 0)
+                    return st;
+
+                pthread_cond_destroy(&q->cond);
+                pthread_mutex_destroy(&q->mutex);
+                s->wq = NULL;
+                free(q->v);
+            }
+            free(q);
+        }
+        apperr("%s: Failed to start write-behind", s->name);
+        return false;
+    }
+    return st;
+#else
+    return (n == 0);
+#endif
+}
+
+// Queue page extent p of length n for writing at offset o, to be linked after
+// the IFD at offset b. Take ownership of p. Block while the queue is full.
+
+bool scm_write_queue(scm *s, long long o, long long b, uint8_t *p, size_t n)
+{
+#ifndef _WIN32
+    struct scm_queue *q = s->wq;
+    bool st = false;
+
+    pthread_mutex_lock(&q->mutex);
+    {
+        while (q->c == q->m && !q->fail)
+            pthread_cond_wait(&q->cond, &q->mutex);
+
+        if (!q->fail)
+        {
+            struct scm_page *t = q->v + (q->i + q->c) % q->m;
+
+            t->o = o;
+            t->b = b;
+            t->p = p;
+            t->n = n;
+
+            q->tail = o + (long long) n;
+            q->c   += 1;
+
+            pthread_cond_broadcast(&q->cond);
+            st = true;
+        }
+    }
+    pthread_mutex_unlock(&q->mutex);
+
+    if (!st) free(p);
+    return st;
+#else
+    free(p);
+    return false;
+#endif
+}
+
+// Return the offset at which the next page of SCM s will be written: the end
+// of the file, or under write-behind, the end of the last queued page.
+
+long long scm_write_tail(scm *s)
+{
+#ifndef _WIN32
+    if (s->wq)
+    {
+        long long o;
+
+        pthread_mutex_lock(&s->wq->mutex);
+        o = s->wq->tail;
+        pthread_mutex_unlock(&s->wq->mutex);
+
+        return o;
+    }
+#endif
+    if (scm_ffwd(s))
+    {
+#ifndef _WIN32
+        if (s->io != SCM_IO_STDIO)
+            return s->at;
+#endif
+        return (long long) ftello(s->fp);
+    }
+    return -1;
+}
+
+// Under write-behind, block until all queued data preceding offset o has been
+// written, or if o is negative, until the queue is empty. Drop any staged
+// extent, as it may predate the data now on disk. Return false if any queued
+// write has failed.
+
+bool scm_sync(scm *s, long long o)
+{
+#ifndef _WIN32
+    struct scm_queue *q = s->wq;
+    bool st = true;
+
+    if (q)
+    {
+        pthread_mutex_lock(&q->mutex);
+
+        while ((q->c || q->busy) && (o < 0 || q->done <= o) && !q->fail)
+            pthread_cond_wait(&q->cond, &q->mutex);
+
+        st = !q->fail;
+
+        pthread_mutex_unlock(&q->mutex);
+
+        s->stgl = 0;
+    }
+    return st;
+#else
+    return true;
+#endif
+}
+
+//------------------------------------------------------------------------------
+
+// Asynchronous reads are serviced by a small pool of worker threads, each with
+// a private shadow of the SCM that shares its file but owns its own scratch and
+// staging buffers. The workers read and decode pages fully in parallel, keeping
+// as many reads in flight as there are workers. Requests wait in a bounded
+// queue.
+
+#define SCM_POOL_DEPTH 64
+
+#ifndef _WIN32
+
+struct scm_job
+{
+    long long   o;              // Offset of the page IFD
+    float      *p;              // Destination page buffer
+    scm_read_fn f;              // Completion callback
+    void       *d;              // Completion callback data
+};
+
+struct scm_pool
+{
+    pthread_mutex_t  mutex;
+    pthread_cond_t   cond;
+
+    struct scm_job   v[SCM_POOL_DEPTH];
+    int              i;         // Index of the first queued job
+    int              c;         // Count of queued jobs
+    int              busy;      // Count of jobs in progress
+    int              stop;      // Workers should exit when idle
+    bool             fail;      // A read has failed since the last wait
+
+    scm             *s;         // Parent SCM
+    scm             *t;         // Worker shadow SCMs
+    pthread_t       *thread;    // Worker threads
+    int              n;         // Worker count
+};
+
+// Asynchronous read worker thread. Read and decode each queued page in turn
+// using the private shadow SCM t.
+
+static void *scm_pool_main(void *data)
+{
+    scm             *t = (scm *) data;
+    struct scm_pool *q = t->rq;
+    struct scm_job   j;
+
+#ifdef _OPENMP
+    omp_set_num_threads(1);
+#endif
+
+    pthread_mutex_lock(&q->mutex);
+
+    while (true)
+    {
+        while (q->c == 0 && q->stop == 0)
+            pthread_cond_wait(&q->cond, &q->mutex);
+
+        if (q->c == 0)
+            break;
+
+        j        = q->v[q->i];
+        q->i     = (q->i + 1) % SCM_POOL_DEPTH;
+        q->c    -= 1;
+        q->busy += 1;
+
+        pthread_cond_broadcast(&q->cond);
+        pthread_mutex_unlock(&q->mutex);
+
+        bool ok = false;
+        ifd  d;
+
+        if (t->cache && scm_cache_get(t, j.o, j.p, false))
+            ok = true;
+
+        else if (scm_stage_ifd(t, &d, j.o))
+        {
+            if ((ok = scm_read_data(t, j.p, false, &d)) && t->cache)
+                scm_cache_put(t, j.o, j.p, false);
+        }
+        if (j.f)
+            j.f(q->s, j.o, j.p, ok, j.d);
+
+        pthread_mutex_lock(&q->mutex);
+
+        if (!ok)
+            q->fail = true;
+
+        q->busy -= 1;
+
+        pthread_cond_broadcast(&q->cond);
+    }
+
+    pthread_mutex_unlock(&q->mutex);
+    return NULL;
+}
+
+// Stop the asynchronous read pool of SCM s, if any, after all queued reads.
+
+static void scm_pool_stop(scm *s)
+{
+    struct scm_pool *q = s->rq;
+
+    pthread_mutex_lock(&q->mutex);
+    q->stop = 1;
+    pthread_cond_broadcast(&q->cond);
+    pthread_mutex_unlock(&q->mutex);
+
+    for (int k = 0; k < q->n; k++)
+    {
+        pthread_join(q->thread[k], NULL);
+        scm_unshadow(q->t + k);
+    }
+
+    pthread_cond_destroy(&q->cond);
+    pthread_mutex_destroy(&q->mutex);
+
+    free(q->thread);
+    free(q->t);
+    free(q);
+
+    s->rq = NULL;
+}
+
+#endif
+
+// Start a pool of n asynchronous read workers on SCM s, or if n is zero, stop
+// it after all queued reads are complete. Return false if the pool cannot be
+// started, in which case all reads remain synchronous.
+
+bool scm_read_pool_init(scm *s, int n)
+{
+#ifndef _WIN32
+    struct scm_pool *q;
+    int k;
+
+    if (s->rq)
+        scm_pool_stop(s);
+
+    if (n > 0)
+    {
+        if ((q = (struct scm_pool *) calloc(1, sizeof (struct scm_pool))))
+        {
+            q->s = s;
+
+            if ((q->t      = (scm       *) calloc((size_t) n, sizeof (scm))) &&
+                (q->thread = (pthread_t *) calloc((size_t) n, sizeof (pthread_t))))
+            {
+                pthread_mutex_init(&q->mutex, NULL);
+                pthread_cond_init (&q->cond,  NULL);
+
+                s->rq = q;
+
+                for (k = 0; k < n; k++)
+                {
+                    scm *t = q->t + k;
+
+                    if (!scm_shadow(t, s))
+                        break;
+
+                    t->rq = q;
+
+                    if (pthread_create(q->thread + k, NULL, scm_pool_main, t))
+                    {
+                        scm_unshadow(t);
+                        break;
+                    }
+                    q->n = k + 1;
+                }
+                if (q->n == n)
+                    return true;
+
+                scm_pool_stop(s);
+                apperr("%s: Failed to start asynchronous reads", s->name);
+                return false;
+            }
+            free(q->t);
+            free(q);
+        }
+        apperr("%s: Failed to start asynchronous reads", s->name);
+        return false;
+    }
+    return true;
+#else
+    return (n == 0);
+#endif
+}
+
+// Queue a read of the page at offset o of SCM s into buffer p, calling f with
+// data d on a worker thread when it completes. Block while the queue is full.
+
+bool scm_read_queue(scm *s, long long o, float *p, scm_read_fn f, void *d)
+{
+#ifndef _WIN32
+    struct scm_pool *q = s->rq;
+
+    pthread_mutex_lock(&q->mutex);
+    {
+        while (q->c == SCM_POOL_DEPTH)
+            pthread_cond_wait(&q->cond, &q->mutex);
+
+        struct scm_job *j = q->v + (q->i + q->c) % SCM_POOL_DEPTH;
+
+        j->o = o;
+        j->p = p;
+        j->f = f;
+        j->d = d;
+
+        q->c += 1;
+
+        pthread_cond_broadcast(&q->cond);
+    }
+    pthread_mutex_unlock(&q->mutex);
+    return true;
+#else
+    return false;
+#endif
+}
+
+// Block until all queued reads of SCM s are complete. Return false if any read
+// has failed since the last wait.
+
+bool scm_read_drain(scm *s)
+{
+#ifndef _WIN32
+    struct scm_pool *q = s->rq;
+    bool st = true;
+
+    if (q)
+    {
+        pthread_mutex_lock(&q->mutex);
+
+        while (q->c || q->busy)
+            pthread_cond_wait(&q->cond, &q->mutex);
+
+        st      = !q->fail;
+        q->fail = false;
+
+        pthread_mutex_unlock(&q->mutex);
+    }
+    return st;
+#else
+    return true;
+#endif
+}
+
+//------------------------------------------------------------------------------
+
+// Advise the operating system of the access pattern of SCM s, one of the
+// SCM_ACCESS values. Hints are advisory and any failure is ignored.
+
+void scm_advise(scm *s, int a)
+{
+#ifndef _WIN32
+    if (s->mp)
+    {
+        int m = (a == SCM_ACCESS_RANDOM)     ? POSIX_MADV_RANDOM
+              : (a == SCM_ACCESS_SEQUENTIAL) ? POSIX_MADV_SEQUENTIAL
+              :                                POSIX_MADV_NORMAL;
+
+        posix_madvise(s->mp, (size_t) s->ml, m);
+    }
+#ifdef POSIX_FADV_NORMAL
+    else
+    {
+        int d = s->fp ? fileno(s->fp) : s->fd;
+        int m = (a == SCM_ACCESS_RANDOM)     ? POSIX_FADV_RANDOM
+              : (a == SCM_ACCESS_SEQUENTIAL) ? POSIX_FADV_SEQUENTIAL
+              :                                POSIX_FADV_NORMAL;
+
+        posix_fadvise(d, 0, 0, m);
+    }
+#endif
+#endif
+}
+
+// Advise the operating system that the page at offset o of SCM s will soon be
+// read. The extent is not known until its IFD is read, so assume it has the
+// length of the last extent staged, or failing that, the worst case.
+
+void scm_prefetch_page(scm *s, long long o)
+{
+#ifndef _WIN32
+    size_t n = s->span;
+
+    if (n == 0)
+        n = scm_extent_bound(s, scm_strips(s));
+
+    if (s->mp)
+    {
+        if (o < s->ml)
+        {
+            long long z = (long long) sysconf(_SC_PAGESIZE);
+            long long a = o - o % z;
+
+            n = (size_t) min((long long) n + (o - a), s->ml - a);
+
+            posix_madvise(s->mp + a, n, POSIX_MADV_WILLNEED);
+        }
+    }
+#ifdef POSIX_FADV_WILLNEED
+    else
+    {
+        int d = s->fp ? fileno(s->fp) : s->fd;
+
+        posix_fadvise(d, (off_t) o, (off_t) n, POSIX_FADV_WILLNEED);
+    }
+#endif
+#endif
+}
+
+//------------------------------------------------------------------------------
+
+// The decoded page cache holds recently-read pages keyed by file offset and by
+// representation, float or raw, evicting the least recently used when full. A
+// hash table locates each page and a doubly-linked list orders them by use.
+// Pages of a file are immutable once written, so cached pages are never
+// invalidated. The cache is shared by all asynchronous read workers and is
+// guarded by a mutex.
+
+struct scm_line
+{
+    long long        o;         // File offset of the page
+    bool             r;         // Page is raw
+    void            *p;         // Decoded page data
+    size_t           z;         // Size of the page data in bytes
+    struct scm_line *prev;      // More recently used page
+    struct scm_line *next;      // Less recently used page
+    struct scm_line *link;      // Next page in the same hash bucket
+};
+
+struct scm_cache
+{
+#ifndef _WIN32
+    pthread_mutex_t  mutex;
+#endif
+    struct scm_line **hv;       // Hash buckets
+    size_t            hm;       // Hash bucket count, a power of two
+    struct scm_line  *head;     // Most recently used page
+    struct scm_line  *tail;     // Least recently used page
+    size_t            c;        // Size of cached pages in bytes
+    size_t            m;        // Capacity in bytes
+
+    long long         hits;
+    long long         misses;
+};
+
+static struct scm_line **scm_cache_find(struct scm_cache *k, long long o,
+                                                                bool r)
+{
+    size_t h = (size_t) (((uint64_t) o * 0x9E3779B97F4A7C15ull) >> 32);
+
+    struct scm_line **l = k->hv + (h & (k->hm - 1));
+
+    while (*l && ((*l)->o != o || (*l)->r != r))
+        l = &(*l)->link;
+
+    return l;
+}
+
+static void scm_cache_unlink(struct scm_cache *k, struct scm_line *l)
+{
+    if (l->prev) l->prev->next = l->next; else k->head = l->next;
+    if (l->next) l->next->prev = l->prev; else k->tail = l->prev;
+}
+
+static void scm_cache_front(struct scm_cache *k, struct scm_line *l)
+{
+    l->prev = NULL;
+    l->next = k->head;
+
+    if (k->head) k->head->prev = l; else k->tail = l;
+
+    k->head = l;
+}
+
+static void scm_cache_lock(struct scm_cache *k)
+{
+#ifndef _WIN32
+    pthread_mutex_lock(&k->mutex);
+#endif
+}
+
+static void scm_cache_unlock(struct scm_cache *k)
+{
+#ifndef _WIN32
+    pthread_mutex_unlock(&k->mutex);
+#endif
+}
+
+// Release the decoded page cache of SCM s, if any, and allocate a new one
+// holding as many pages as fit in n bytes. If n is zero, disable caching.
+
+bool scm_cache_init(scm *s, size_t n)
+{
+    struct scm_cache *k;
+    struct scm_line  *l;
+
+    if ((k = s->cache))
+    {
+        while ((l = k->head))
+        {
+            k->head = l->next;
+            free(l->p);
+            free(l);
+        }
+#ifndef _WIN32
+        pthread_mutex_destroy(&k->mutex);
+#endif
+        free(k->hv);
+        free(k);
+
+        s->cache = NULL;
+    }
+
+    if (n)
+    {
+        const size_t z = scm_page_size(s, false);
+
+        if (n < z)
+            return true;
+
+        if ((k = (struct scm_cache *) calloc(1, sizeof (struct scm_cache))))
+        {
+            k->m  = n;
+            k->hm = 1;
+
+            // Size the hash table for the most pages that may fit.
+
+            while (k->hm < 2 * (n / scm_page_size(s, true)))
+                k->hm *= 2;
+
+            if ((k->hv = (struct scm_line **) calloc(k->hm, sizeof (void *))))
+            {
+#ifndef _WIN32
+                pthread_mutex_init(&k->mutex, NULL);
+#endif
+                s->cache = k;
+                return true;
+            }
+            free(k);
+        }
+        apperr("%s: Failed to allocate page cache", s->name);
+        return false;
+    }
+    return true;
+}
+
+// If the page at offset o of SCM s is cached in float or raw form, as given by
+// r, copy it to p and return true.
+
+bool scm_cache_get(scm *s, long long o, void *p, bool r)
+{
+    struct scm_cache *k = s->cache;
+    struct scm_line  *l;
+
+    scm_cache_lock(k);
+
+    if ((l = *scm_cache_find(k, o, r)))
+    {
+        scm_cache_unlink(k, l);
+        scm_cache_front (k, l);
+        memcpy(p, l->p, l->z);
+        k->hits++;
+    }
+    else k->misses++;
+
+    scm_cache_unlock(k);
+
+    return (l != NULL);
+}
+
+// Cache a copy of float or raw page p read from offset o of SCM s, evicting the
+// least recently used pages until it fits.
+
+void scm_cache_put(scm *s, long long o, const void *p, bool r)
+{
+    struct scm_cache *k = s->cache;
+    struct scm_line **b;
+    struct scm_line  *l = NULL;
+
+    const size_t z = scm_page_size(s, r);
+
+    scm_cache_lock(k);
+
+    if (*(b = scm_cache_find(k, o, r)) == NULL)
+    {
+        while (k->tail && k->c + z > k->m)
+        {
+            struct scm_line **t;
+
+            l = k->tail;
+            t = scm_cache_find(k, l->o, l->r);
+           *t = l->link;
+
+            scm_cache_unlink(k, l);
+
+            k->c -= l->z;
+            free(l->p);
+            free(l);
+        }
+
+        b = scm_cache_find(k, o, r);
+
+        if ((l = (struct scm_line *) calloc(1, sizeof (struct scm_line))))
+        {
+            if ((l->p = malloc(z)))
+            {
+                memcpy(l->p, p, z);
+
+                l->o    = o;
+                l->r    = r;
+                l->z    = z;
+                l->link = NULL;
+               *b       = l;
+
+                k->c += z;
+
+                scm_cache_front(k, l);
+            }
+            else free(l);
+        }
+    }
+
+    scm_cache_unlock(k);
+}
+
+// Return the hit and miss counts of the decoded page cache of SCM s.
+
+void scm_cache_stats(scm *s, long long *hits, long long *misses)
+{
+    struct scm_cache *k = s->cache;
+
+    *hits   = 0;
+    *misses = 0;
+
+    if (k)
+    {
+        scm_cache_lock(k);
+        *hits   = k->hits;
+        *misses = k->misses;
+        scm_cache_unlock(k);
     }
-    return false;
 }
 
 //------------------------------------------------------------------------------
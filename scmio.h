@@ -25,11 +25,27 @@
 bool      scm_alloc(scm *);
 void      scm_free (scm *);
 
+bool      scm_shadow  (scm *, scm *);
+void      scm_unshadow(scm *);
+
+bool      scm_fopen(scm *, const char *, const char *);
+void      scm_fclose(scm *);
+void      scm_flush(scm *);
+
 bool      scm_ffwd (scm *);
 bool      scm_seek (scm *,                       long long);
 bool      scm_read (scm *,       void *, size_t, long long);
 long long scm_write(scm *, const void *, size_t);
-long long scm_align(scm *);
+bool      scm_write_at(scm *, const void *, size_t, long long);
+long long scm_align(scm *, int);
+
+void     *scm_map  (scm *, size_t, long long, void **, size_t *);
+void      scm_unmap(void *, size_t);
+
+const uint8_t *scm_mapped(scm *, size_t, long long);
+
+void      scm_advise       (scm *, int);
+void      scm_prefetch_page(scm *, long long);
 
 //------------------------------------------------------------------------------
 
@@ -46,23 +62,42 @@ long long scm_write_hfd     (scm *, hfd *, long long);
 bool      scm_init_ifd      (scm *, ifd *);
 bool      scm_read_ifd      (scm *, ifd *, long long);
 long long scm_write_ifd     (scm *, ifd *, long long);
+bool      scm_stage_ifd     (scm *, ifd *, long long);
 
 bool      scm_read_preamble (scm *);
 bool      scm_write_preamble(scm *);
 
 //------------------------------------------------------------------------------
 
-bool scm_read_zips (scm *, uint8_t **, uint64_t,   uint64_t,   uint16_t,
-                                                   uint64_t *, uint32_t *);
-bool scm_write_zips(scm *, uint8_t **, uint64_t *, uint64_t *, uint16_t *,
-                                                   uint64_t *, uint32_t *);
+bool scm_read_zips (scm *, uint8_t **, const ifd *, uint64_t *, uint32_t *);
+uint8_t *scm_pack_zips(scm *, ifd *, uint8_t **, const uint32_t *, uint16_t,
+                                                      long long, size_t *);
 
-bool scm_read_data (scm *,       float *, uint64_t,   uint64_t,   uint16_t);
-bool scm_write_data(scm *, const float *, uint64_t *, uint64_t *, uint16_t *);
+bool scm_read_part (scm *,       void *, bool, const ifd *, int, int, int, int);
+bool scm_read_data (scm *,       void *, bool, const ifd *);
+bool scm_code_data (scm *, const void *, bool, uint32_t *, uint16_t *, int *);
+void scm_code_stats(scm *, int, long long *, long long *, long long *);
 
 //------------------------------------------------------------------------------
 
-bool scm_link_list(scm *, long long, long long);
+bool      scm_link_list(scm *, long long, long long);
+long long scm_scan_list(scm *, long long, long long **);
+
+//------------------------------------------------------------------------------
+
+bool      scm_write_queue_init(scm *, int);
+bool      scm_write_queue(scm *, long long, long long, uint8_t *, size_t);
+long long scm_write_tail (scm *);
+bool      scm_sync       (scm *, long long);
+
+bool      scm_read_pool_init(scm *, int);
+bool      scm_read_queue    (scm *, long long, float *, scm_read_fn, void *);
+bool      scm_read_drain    (scm *);
+
+bool      scm_cache_init (scm *, size_t);
+bool      scm_cache_get  (scm *, long long, void *, bool);
+void      scm_cache_put  (scm *, long long, const void *, bool);
+void      scm_cache_stats(scm *, long long *, long long *);
 
 //------------------------------------------------------------------------------
 
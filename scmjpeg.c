@@ -20,6 +20,8 @@ static int opt_zipquality  = 9;
 #define TIFFTAG_SCM_MINIMUM 0xFFB3
 #define TIFFTAG_SCM_MAXIMUM 0xFFB4
 
+#define COMPRESSION_SCM_CONST 0xFFB6
+
 static void extensions(TIFF *T)
 {
     static const TIFFFieldInfo fields[] = {
@@ -57,6 +59,14 @@ void copypv(TIFF *S, TIFF *D, ttag_t tag)
         TIFFSetField(D, tag,  n,  p);
 }
 
+// Fill the first n bytes of buffer p with copies of the k-byte pixel q.
+
+static void broadcast(uint8 *p, tsize_t n, const uint8 *q, tsize_t k)
+{
+    for (tsize_t i = 0; i + k <= n; i += k)
+        memcpy(p + i, q, k);
+}
+
 int proc(const char *src, const char *dst)
 {
     void   *ptr = NULL;
@@ -122,13 +132,36 @@ int proc(const char *src, const char *dst)
                     syserr("Failed to allocate strip buffer size %d", ss);
             }
 
+            // A uniform page may have SCM constant compression, which LibTIFF
+            // can't decode. Its first strip holds just its one pixel, so read
+            // that raw and broadcast it to each strip.
+
+            uint16  z = 0;
+            uint32  h = 0;
+            uint32  r = 0;
+            uint8   pix[64];
+            tsize_t pn = 0;
+
+            if (TIFFGetField(S, TIFFTAG_COMPRESSION,  &z) &&
+                TIFFGetField(S, TIFFTAG_IMAGELENGTH,  &h) &&
+                TIFFGetField(S, TIFFTAG_ROWSPERSTRIP, &r) &&
+                z == COMPRESSION_SCM_CONST)
+                pn = TIFFReadRawStrip(S, 0, (tdata_t) pix, sizeof (pix));
+
             // Copy and re-encode each strip.
 
             tsize_t i;
 
             for (i = 0; i < ns; ++i)
             {
-                if ((ss = TIFFReadEncodedStrip (S, i, (tdata_t) ptr, -1)) == -1)
+                if (pn > 0)
+                {
+                    uint32 k = (uint32) i * r;
+
+                    ss = TIFFVStripSize(S, (h - k < r) ? h - k : r);
+                    broadcast((uint8 *) ptr, ss, pix, pn);
+                }
+                else if ((ss = TIFFReadEncodedStrip(S, i, ptr, -1)) == -1)
                     memset(ptr, 0, (ss = len));
 
                 if ((ss = TIFFWriteEncodedStrip(D, i, (tdata_t) ptr, ss)) == -1)
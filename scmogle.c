@@ -150,7 +150,7 @@ static int data_init(int argc, char **argv)
     if ((filev = (struct file *) calloc((size_t) argc, sizeof (struct file))))
     {
         for (int argi = 1; argi < argc; ++argi)
-            if ((filev[i].s = scm_ifile(argv[argi])))
+            if ((filev[i].s = scm_ifile_io(argv[argi], SCM_IO_MMAP)))
             {
                 const int n = scm_get_n(filev[i].s) + 2;
                 const int c = scm_get_c(filev[i].s);
@@ -158,6 +158,8 @@ static int data_init(int argc, char **argv)
                 N = max(N, n);
                 C = max(C, c);
 
+                scm_set_cache(filev[i].s, (size_t) 128 << 20);
+
                 glGenTextures  (1, &filev[i].texture);
                 glBindTexture  (T,  filev[i].texture);
                 glTexParameteri(T, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
@@ -0,0 +1,819 @@
+// SCMTIFF Copyright (C) 2012-2015 Robert Kooima
+//
+// This program is free software: you can redistribute it and/or modify it
+// under the terms of the GNU General Public License as published by the Free
+// Software Foundation, either version 3 of the License, or (at your option)
+// any later version.
+//
+// This program is distributed in the hope that it will be useful, but WITH-
+// OUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+// FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License for
+// more details.
+
+#include <stdint.h>
+#include <string.h>
+#include <stdio.h>
+
+#if defined(__x86_64__) || defined(_M_X64)
+#define SCM_X86
+#endif
+
+#ifdef SCM_X86
+#include <immintrin.h>
+#ifdef _MSC_VER
+#include <intrin.h>
+#define TARGET(t)
+#else
+#define TARGET(t) __attribute__((target(t)))
+#endif
+#endif
+
+#include "scmdat.h"
+#include "util.h"
+
+//------------------------------------------------------------------------------
+// The following SIMD kernels accelerate the sample conversions performed upon
+// every strip read or written. Each produces output bit-exact with the scalar
+// reference: integer samples are clamped, scaled, and truncated toward zero,
+// and NaN becomes zero, while half-precision samples are rounded to nearest
+// even. The kernels are compiled for their instruction set regardless of
+// compiler flags, and the best supported by the CPU is selected at run time.
+
+//------------------------------------------------------------------------------
+
+#ifdef SCM_X86
+
+// Clamp, scale, and truncate four floats to 32-bit integers. NaN becomes zero.
+
+TARGET("sse2")
+static inline __m128i ucvt_sse2(const float *f, __m128 k)
+{
+    __m128 x = _mm_loadu_ps(f);
+
+    x = _mm_max_ps(x, _mm_setzero_ps());
+    x = _mm_min_ps(x, _mm_set1_ps(1.f));
+
+    return _mm_cvttps_epi32(_mm_mul_ps(x, k));
+}
+
+TARGET("sse2")
+static inline __m128i scvt_sse2(const float *f, __m128 k)
+{
+    __m128 x = _mm_loadu_ps(f);
+
+    x = _mm_and_ps(x, _mm_cmpord_ps(x, x));
+    x = _mm_max_ps(x, _mm_set1_ps(-1.f));
+    x = _mm_min_ps(x, _mm_set1_ps( 1.f));
+
+    return _mm_cvttps_epi32(_mm_mul_ps(x, k));
+}
+
+// Encode floats to integer samples using SSE2. Return the count encoded.
+
+TARGET("sse2")
+static size_t ftob_sse2(void *p, const float *f, size_t n, int b, int g)
+{
+    size_t i = 0;
+
+    if      (b ==  8 && g == 0)
+    {
+        const __m128 k = _mm_set1_ps(255.f);
+
+        for (; i + 16 <= n; i += 16)
+        {
+            __m128i a = _mm_packs_epi32(ucvt_sse2(f + i +  0, k),
+                                        ucvt_sse2(f + i +  4, k));
+            __m128i c = _mm_packs_epi32(ucvt_sse2(f + i +  8, k),
+                                        ucvt_sse2(f + i + 12, k));
+            _mm_storeu_si128((__m128i *) ((uint8_t *) p + i),
+                             _mm_packus_epi16(a, c));
+        }
+    }
+    else if (b == 16 && g == 0)
+    {
+        // SSE2 lacks an unsigned 32-to-16 pack, so bias to signed and back.
+
+        const __m128  k = _mm_set1_ps(65535.f);
+        const __m128i o = _mm_set1_epi32(32768);
+        const __m128i h = _mm_set1_epi16((short) 0x8000);
+
+        for (; i + 8 <= n; i += 8)
+        {
+            __m128i a = _mm_sub_epi32(ucvt_sse2(f + i + 0, k), o);
+            __m128i c = _mm_sub_epi32(ucvt_sse2(f + i + 4, k), o);
+            _mm_storeu_si128((__m128i *) ((uint16_t *) p + i),
+                             _mm_xor_si128(_mm_packs_epi32(a, c), h));
+        }
+    }
+    else if (b ==  8 && g == 1)
+    {
+        const __m128 k = _mm_set1_ps(127.f);
+
+        for (; i + 16 <= n; i += 16)
+        {
+            __m128i a = _mm_packs_epi32(scvt_sse2(f + i +  0, k),
+                                        scvt_sse2(f + i +  4, k));
+            __m128i c = _mm_packs_epi32(scvt_sse2(f + i +  8, k),
+                                        scvt_sse2(f + i + 12, k));
+            _mm_storeu_si128((__m128i *) ((int8_t *) p + i),
+                             _mm_packs_epi16(a, c));
+        }
+    }
+    else if (b == 16 && g == 1)
+    {
+        const __m128 k = _mm_set1_ps(32767.f);
+
+        for (; i + 8 <= n; i += 8)
+        {
+            __m128i a = scvt_sse2(f + i + 0, k);
+            __m128i c = scvt_sse2(f + i + 4, k);
+            _mm_storeu_si128((__m128i *) ((int16_t *) p + i),
+                             _mm_packs_epi32(a, c));
+        }
+    }
+    return i;
+}
+
+// Decode integer samples to floats using SSE2. Return the count decoded.
+
+TARGET("sse2")
+static size_t btof_sse2(const void *p, float *f, size_t n, int b, int g)
+{
+    const __m128i z = _mm_setzero_si128();
+
+    size_t i = 0;
+
+    if      (b ==  8 && g == 0)
+    {
+        const __m128 k = _mm_set1_ps(255.f);
+
+        for (; i + 16 <= n; i += 16)
+        {
+            __m128i x = _mm_loadu_si128((const __m128i *) ((const uint8_t *) p + i));
+            __m128i a = _mm_unpacklo_epi8(x, z);
+            __m128i c = _mm_unpackhi_epi8(x, z);
+
+            _mm_storeu_ps(f + i +  0, _mm_div_ps(_mm_cvtepi32_ps(_mm_unpacklo_epi16(a, z)), k));
+            _mm_storeu_ps(f + i +  4, _mm_div_ps(_mm_cvtepi32_ps(_mm_unpackhi_epi16(a, z)), k));
+            _mm_storeu_ps(f + i +  8, _mm_div_ps(_mm_cvtepi32_ps(_mm_unpacklo_epi16(c, z)), k));
+            _mm_storeu_ps(f + i + 12, _mm_div_ps(_mm_cvtepi32_ps(_mm_unpackhi_epi16(c, z)), k));
+        }
+    }
+    else if (b == 16 && g == 0)
+    {
+        const __m128 k = _mm_set1_ps(65535.f);
+
+        for (; i + 8 <= n; i += 8)
+        {
+            __m128i x = _mm_loadu_si128((const __m128i *) ((const uint16_t *) p + i));
+
+            _mm_storeu_ps(f + i + 0, _mm_div_ps(_mm_cvtepi32_ps(_mm_unpacklo_epi16(x, z)), k));
+            _mm_storeu_ps(f + i + 4, _mm_div_ps(_mm_cvtepi32_ps(_mm_unpackhi_epi16(x, z)), k));
+        }
+    }
+    else if (b ==  8 && g == 1)
+    {
+        const __m128 k = _mm_set1_ps(127.f);
+
+        // Sign-extend by unpacking each value into the high half and shifting.
+
+        for (; i + 16 <= n; i += 16)
+        {
+            __m128i x = _mm_loadu_si128((const __m128i *) ((const int8_t *) p + i));
+            __m128i a = _mm_srai_epi16(_mm_unpacklo_epi8(x, x), 8);
+            __m128i c = _mm_srai_epi16(_mm_unpackhi_epi8(x, x), 8);
+
+            _mm_storeu_ps(f + i +  0, _mm_div_ps(_mm_cvtepi32_ps(_mm_srai_epi32(_mm_unpacklo_epi16(a, a), 16)), k));
+            _mm_storeu_ps(f + i +  4, _mm_div_ps(_mm_cvtepi32_ps(_mm_srai_epi32(_mm_unpackhi_epi16(a, a), 16)), k));
+            _mm_storeu_ps(f + i +  8, _mm_div_ps(_mm_cvtepi32_ps(_mm_srai_epi32(_mm_unpacklo_epi16(c, c), 16)), k));
+            _mm_storeu_ps(f + i + 12, _mm_div_ps(_mm_cvtepi32_ps(_mm_srai_epi32(_mm_unpackhi_epi16(c, c), 16)), k));
+        }
+    }
+    else if (b == 16 && g == 1)
+    {
+        const __m128 k = _mm_set1_ps(32767.f);
+
+        for (; i + 8 <= n; i += 8)
+        {
+            __m128i x = _mm_loadu_si128((const __m128i *) ((const int16_t *) p + i));
+
+            _mm_storeu_ps(f + i + 0, _mm_div_ps(_mm_cvtepi32_ps(_mm_srai_epi32(_mm_unpacklo_epi16(x, x), 16)), k));
+            _mm_storeu_ps(f + i + 4, _mm_div_ps(_mm_cvtepi32_ps(_mm_srai_epi32(_mm_unpackhi_epi16(x, x), 16)), k));
+        }
+    }
+    return i;
+}
+
+//------------------------------------------------------------------------------
+
+// Clamp, scale, and truncate eight floats to 32-bit integers. NaN becomes zero.
+
+TARGET("avx2")
+static inline __m256i ucvt_avx2(const float *f, __m256 k)
+{
+    __m256 x = _mm256_loadu_ps(f);
+
+    x = _mm256_max_ps(x, _mm256_setzero_ps());
+    x = _mm256_min_ps(x, _mm256_set1_ps(1.f));
+
+    return _mm256_cvttps_epi32(_mm256_mul_ps(x, k));
+}
+
+TARGET("avx2")
+static inline __m256i scvt_avx2(const float *f, __m256 k)
+{
+    __m256 x = _mm256_loadu_ps(f);
+
+    x = _mm256_and_ps(x, _mm256_cmp_ps(x, x, _CMP_ORD_Q));
+    x = _mm256_max_ps(x, _mm256_set1_ps(-1.f));
+    x = _mm256_min_ps(x, _mm256_set1_ps( 1.f));
+
+    return _mm256_cvttps_epi32(_mm256_mul_ps(x, k));
+}
+
+// Pack the low and high 128-bit lanes of eight 32-bit integers into 16 bits.
+
+TARGET("avx2")
+static inline __m128i upack_avx2(__m256i x)
+{
+    return _mm_packus_epi32(_mm256_castsi256_si128(x),
+                            _mm256_extracti128_si256(x, 1));
+}
+
+TARGET("avx2")
+static inline __m128i spack_avx2(__m256i x)
+{
+    return _mm_packs_epi32(_mm256_castsi256_si128(x),
+                           _mm256_extracti128_si256(x, 1));
+}
+
+// Encode floats to integer or half-precision samples using AVX2 and F16C.
+// Return the count encoded.
+
+TARGET("avx2,f16c")
+static size_t ftob_avx2(void *p, const float *f, size_t n, int b, int g)
+{
+    size_t i = 0;
+
+    if      (b ==  8 && g == 0)
+    {
+        const __m256 k = _mm256_set1_ps(255.f);
+
+        for (; i + 16 <= n; i += 16)
+            _mm_storeu_si128((__m128i *) ((uint8_t *) p + i),
+                             _mm_packus_epi16(upack_avx2(ucvt_avx2(f + i + 0, k)),
+                                              upack_avx2(ucvt_avx2(f + i + 8, k))));
+    }
+    else if (b == 16 && g == 0)
+    {
+        const __m256 k = _mm256_set1_ps(65535.f);
+
+        for (; i + 8 <= n; i += 8)
+            _mm_storeu_si128((__m128i *) ((uint16_t *) p + i),
+                             upack_avx2(ucvt_avx2(f + i, k)));
+    }
+    else if (b ==  8 && g == 1)
+    {
+        const __m256 k = _mm256_set1_ps(127.f);
+
+        for (; i + 16 <= n; i += 16)
+            _mm_storeu_si128((__m128i *) ((int8_t *) p + i),
+                             _mm_packs_epi16(spack_avx2(scvt_avx2(f + i + 0, k)),
+                                             spack_avx2(scvt_avx2(f + i + 8, k))));
+    }
+    else if (b == 16 && g == 1)
+    {
+        const __m256 k = _mm256_set1_ps(32767.f);
+
+        for (; i + 8 <= n; i += 8)
+            _mm_storeu_si128((__m128i *) ((int16_t *) p + i),
+                             spack_avx2(scvt_avx2(f + i, k)));
+    }
+    else if (b == 16 && g == 2)
+    {
+        for (; i + 8 <= n; i += 8)
+            _mm_storeu_si128((__m128i *) ((uint16_t *) p + i),
+                             _mm256_cvtps_ph(_mm256_loadu_ps(f + i),
+                                             _MM_FROUND_TO_NEAREST_INT));
+    }
+    return i;
+}
+
+// Decode integer or half-precision samples to floats using AVX2 and F16C.
+// Return the count decoded.
+
+TARGET("avx2,f16c")
+static size_t btof_avx2(const void *p, float *f, size_t n, int b, int g)
+{
+    size_t i = 0;
+
+    if      (b ==  8 && g == 0)
+    {
+        const __m256 k = _mm256_set1_ps(255.f);
+
+        for (; i + 8 <= n; i += 8)
+        {
+            __m128i x = _mm_loadl_epi64((const __m128i *) ((const uint8_t *) p + i));
+            _mm256_storeu_ps(f + i, _mm256_div_ps(_mm256_cvtepi32_ps(_mm256_cvtepu8_epi32(x)), k));
+        }
+    }
+    else if (b == 16 && g == 0)
+    {
+        const __m256 k = _mm256_set1_ps(65535.f);
+
+        for (; i + 8 <= n; i += 8)
+        {
+            __m128i x = _mm_loadu_si128((const __m128i *) ((const uint16_t *) p + i));
+            _mm256_storeu_ps(f + i, _mm256_div_ps(_mm256_cvtepi32_ps(_mm256_cvtepu16_epi32(x)), k));
+        }
+    }
+    else if (b ==  8 && g == 1)
+    {
+        const __m256 k = _mm256_set1_ps(127.f);
+
+        for (; i + 8 <= n; i += 8)
+        {
+            __m128i x = _mm_loadl_epi64((const __m128i *) ((const int8_t *) p + i));
+            _mm256_storeu_ps(f + i, _mm256_div_ps(_mm256_cvtepi32_ps(_mm256_cvtepi8_epi32(x)), k));
+        }
+    }
+    else if (b == 16 && g == 1)
+    {
+        const __m256 k = _mm256_set1_ps(32767.f);
+
+        for (; i + 8 <= n; i += 8)
+        {
+            __m128i x = _mm_loadu_si128((const __m128i *) ((const int16_t *) p + i));
+            _mm256_storeu_ps(f + i, _mm256_div_ps(_mm256_cvtepi32_ps(_mm256_cvtepi16_epi32(x)), k));
+        }
+    }
+    else if (b == 16 && g == 2)
+    {
+        for (; i + 8 <= n; i += 8)
+        {
+            __m128i x = _mm_loadu_si128((const __m128i *) ((const uint16_t *) p + i));
+            _mm256_storeu_ps(f + i, _mm256_cvtph_ps(x));
+        }
+    }
+    return i;
+}
+
+//------------------------------------------------------------------------------
+
+// Clamp, scale, and truncate sixteen floats to 32-bit integers. NaN becomes 0.
+
+TARGET("avx512f")
+static inline __m512i ucvt_avx512(const float *f, __m512 k)
+{
+    __m512 x = _mm512_loadu_ps(f);
+
+    x = _mm512_max_ps(x, _mm512_setzero_ps());
+    x = _mm512_min_ps(x, _mm512_set1_ps(1.f));
+
+    return _mm512_cvttps_epi32(_mm512_mul_ps(x, k));
+}
+
+TARGET("avx512f")
+static inline __m512i scvt_avx512(const float *f, __m512 k)
+{
+    __m512 x = _mm512_loadu_ps(f);
+
+    x = _mm512_maskz_mov_ps(_mm512_cmp_ps_mask(x, x, _CMP_ORD_Q), x);
+    x = _mm512_max_ps(x, _mm512_set1_ps(-1.f));
+    x = _mm512_min_ps(x, _mm512_set1_ps( 1.f));
+
+    return _mm512_cvttps_epi32(_mm512_mul_ps(x, k));
+}
+
+// Encode floats to integer or half-precision samples using AVX-512. Values are
+// in range after clamping, so the truncating narrowing conversions are exact.
+
+TARGET("avx512f")
+static size_t ftob_avx512(void *p, const float *f, size_t n, int b, int g)
+{
+    const __m512 k = _mm512_set1_ps(b == 8 ? (g ? 127.f :   255.f)
+                                           : (g ? 32767.f : 65535.f));
+    size_t i = 0;
+
+    if      (b ==  8 && g == 0)
+        for (; i + 16 <= n; i += 16)
+            _mm_storeu_si128((__m128i *) ((uint8_t *) p + i),
+                             _mm512_cvtepi32_epi8(ucvt_avx512(f + i, k)));
+
+    else if (b == 16 && g == 0)
+        for (; i + 16 <= n; i += 16)
+            _mm256_storeu_si256((__m256i *) ((uint16_t *) p + i),
+                                _mm512_cvtepi32_epi16(ucvt_avx512(f + i, k)));
+
+    else if (b ==  8 && g == 1)
+        for (; i + 16 <= n; i += 16)
+            _mm_storeu_si128((__m128i *) ((int8_t *) p + i),
+                             _mm512_cvtepi32_epi8(scvt_avx512(f + i, k)));
+
+    else if (b == 16 && g == 1)
+        for (; i + 16 <= n; i += 16)
+            _mm256_storeu_si256((__m256i *) ((int16_t *) p + i),
+                                _mm512_cvtepi32_epi16(scvt_avx512(f + i, k)));
+
+    else if (b == 16 && g == 2)
+        for (; i + 16 <= n; i += 16)
+            _mm256_storeu_si256((__m256i *) ((uint16_t *) p + i),
+                                _mm512_cvtps_ph(_mm512_loadu_ps(f + i),
+                                                _MM_FROUND_TO_NEAREST_INT));
+    return i;
+}
+
+// Decode integer or half-precision samples to floats using AVX-512. Return the
+// count decoded.
+
+TARGET("avx512f")
+static size_t btof_avx512(const void *p, float *f, size_t n, int b, int g)
+{
+    const __m512 k = _mm512_set1_ps(b == 8 ? (g ? 127.f :   255.f)
+                                           : (g ? 32767.f : 65535.f));
+    size_t i = 0;
+
+    if      (b ==  8 && g == 0)
+        for (; i + 16 <= n; i += 16)
+        {
+            __m128i x = _mm_loadu_si128((const __m128i *) ((const uint8_t *) p + i));
+            _mm512_storeu_ps(f + i, _mm512_div_ps(_mm512_cvtepi32_ps(_mm512_cvtepu8_epi32(x)), k));
+        }
+
+    else if (b == 16 && g == 0)
+        for (; i + 16 <= n; i += 16)
+        {
+            __m256i x = _mm256_loadu_si256((const __m256i *) ((const uint16_t *) p + i));
+            _mm512_storeu_ps(f + i, _mm512_div_ps(_mm512_cvtepi32_ps(_mm512_cvtepu16_epi32(x)), k));
+        }
+
+    else if (b ==  8 && g == 1)
+        for (; i + 16 <= n; i += 16)
+        {
+            __m128i x = _mm_loadu_si128((const __m128i *) ((const int8_t *) p + i));
+            _mm512_storeu_ps(f + i, _mm512_div_ps(_mm512_cvtepi32_ps(_mm512_cvtepi8_epi32(x)), k));
+        }
+
+    else if (b == 16 && g == 1)
+        for (; i + 16 <= n; i += 16)
+        {
+            __m256i x = _mm256_loadu_si256((const __m256i *) ((const int16_t *) p + i));
+            _mm512_storeu_ps(f + i, _mm512_div_ps(_mm512_cvtepi32_ps(_mm512_cvtepi16_epi32(x)), k));
+        }
+
+    else if (b == 16 && g == 2)
+        for (; i + 16 <= n; i += 16)
+        {
+            __m256i x = _mm256_loadu_si256((const __m256i *) ((const uint16_t *) p + i));
+            _mm512_storeu_ps(f + i, _mm512_cvtph_ps(x));
+        }
+
+    return i;
+}
+
+//------------------------------------------------------------------------------
+// The horizontal difference predictor operates upon rows of interleaved pixels
+// of d bytes each, with samples of e bytes each. Decoding is a prefix sum with
+// stride d, computed within each register by log-step shifts and adds, and
+// carried between registers by replicating the last pixel of each across the
+// next. Byte shifts by a variable count require a switch, which is resolved at
+// compile time as the kernels are instantiated with constant d and e.
+
+TARGET("sse2")
+static inline __m128i sll_sse2(__m128i x, int k)
+{
+    switch (k)
+    {
+        case  1: return _mm_slli_si128(x,  1);
+        case  2: return _mm_slli_si128(x,  2);
+        case  3: return _mm_slli_si128(x,  3);
+        case  4: return _mm_slli_si128(x,  4);
+        case  6: return _mm_slli_si128(x,  6);
+        case  8: return _mm_slli_si128(x,  8);
+        case 12: return _mm_slli_si128(x, 12);
+    }
+    return x;
+}
+
+TARGET("sse2")
+static inline __m128i srl_sse2(__m128i x, int k)
+{
+    switch (k)
+    {
+        case  8: return _mm_srli_si128(x,  8);
+        case 10: return _mm_srli_si128(x, 10);
+        case 12: return _mm_srli_si128(x, 12);
+        case 13: return _mm_srli_si128(x, 13);
+        case 14: return _mm_srli_si128(x, 14);
+        case 15: return _mm_srli_si128(x, 15);
+    }
+    return x;
+}
+
+TARGET("sse2")
+static inline __m128i add_sse2(__m128i x, __m128i y, int e)
+{
+    return (e == 1) ? _mm_add_epi8(x, y) : _mm_add_epi16(x, y);
+}
+
+TARGET("sse2")
+static inline __m128i sub_sse2(__m128i x, __m128i y, int e)
+{
+    return (e == 1) ? _mm_sub_epi8(x, y) : _mm_sub_epi16(x, y);
+}
+
+// Apply the predictor to the z bytes at q, working backward so that each pixel
+// is differenced against its predecessor before that predecessor is modified.
+// Return the count of leading bytes not yet processed.
+
+TARGET("sse2")
+static inline size_t enhdif_sse2(uint8_t *q, size_t z, int d, int e)
+{
+    size_t j = z;
+
+    while (j >= (size_t) d + 16)
+    {
+        j -= 16;
+
+        __m128i x = _mm_loadu_si128((const __m128i *) (q + j));
+        __m128i y = _mm_loadu_si128((const __m128i *) (q + j - d));
+
+        _mm_storeu_si128((__m128i *) (q + j), sub_sse2(x, y, e));
+    }
+    return j;
+}
+
+// Reverse the predictor upon the z bytes at q. Return the count processed.
+
+TARGET("sse2")
+static inline size_t dehdif_sse2(uint8_t *q, size_t z, int d, int e)
+{
+    __m128i y = _mm_setzero_si128();
+    size_t  i = 0;
+    int     k;
+
+    for (; i + 16 <= z; i += 16)
+    {
+        __m128i x = _mm_loadu_si128((const __m128i *) (q + i));
+
+        for (k = d; k < 16; k *= 2)
+            x = add_sse2(x, sll_sse2(x, k), e);
+
+        x = add_sse2(x, y, e);
+        _mm_storeu_si128((__m128i *) (q + i), x);
+
+        for (y = srl_sse2(x, 16 - d), k = d; k < 16; k *= 2)
+            y = _mm_or_si128(y, sll_sse2(y, k));
+    }
+    return i;
+}
+
+// Dispatch the predictor kernels upon pixel size, giving each a constant d.
+
+#define SCM_HDIF_CASES(f, q, z, c, e) \
+    switch ((c) * (e))                \
+    {                                 \
+        case 1: return f(q, z, 1, e); \
+        case 2: return f(q, z, 2, e); \
+        case 3: return f(q, z, 3, e); \
+        case 4: return f(q, z, 4, e); \
+        case 6: return f(q, z, 6, e); \
+        case 8: return f(q, z, 8, e); \
+    }
+
+TARGET("sse2")
+static size_t enhdif_sse2_8(uint8_t *q, size_t z, int c)
+{
+    SCM_HDIF_CASES(enhdif_sse2, q, z, c, 1);
+    return z;
+}
+
+TARGET("sse2")
+static size_t enhdif_sse2_16(uint8_t *q, size_t z, int c)
+{
+    SCM_HDIF_CASES(enhdif_sse2, q, z, c, 2);
+    return z;
+}
+
+TARGET("sse2")
+static size_t dehdif_sse2_8(uint8_t *q, size_t z, int c)
+{
+    SCM_HDIF_CASES(dehdif_sse2, q, z, c, 1);
+    return 0;
+}
+
+TARGET("sse2")
+static size_t dehdif_sse2_16(uint8_t *q, size_t z, int c)
+{
+    SCM_HDIF_CASES(dehdif_sse2, q, z, c, 2);
+    return 0;
+}
+
+#endif
+
+//------------------------------------------------------------------------------
+
+// Determine the most capable instruction set supported by this CPU and OS. The
+// AVX2 kernels also use F16C, which every AVX2 processor provides.
+
+int scm_simd_detect(void)
+{
+#if defined(SCM_X86) && defined(_MSC_VER)
+    int r[4];
+
+    __cpuid(r, 0);
+
+    if (r[0] >= 7)
+    {
+        int c;
+
+        __cpuid(r, 1);
+        c = r[2];
+
+        // Require that the OS saves the YMM and ZMM state with XSAVE.
+
+        if (c & (1 << 27))
+        {
+            unsigned long long x = _xgetbv(0);
+
+            __cpuidex(r, 7, 0);
+
+            if ((r[1] & (1 << 16)) && (x & 0xE6) == 0xE6)
+                return SCM_SIMD_AVX512;
+            if ((r[1] & (1 <<  5)) && (x & 0x06) == 0x06 && (c & (1 << 29)))
+                return SCM_SIMD_AVX2;
+        }
+    }
+    return SCM_SIMD_SSE2;
+
+#elif defined(SCM_X86)
+    __builtin_cpu_init();
+
+    if (__builtin_cpu_supports("avx512f")) return SCM_SIMD_AVX512;
+    if (__builtin_cpu_supports("avx2") &&
+        __builtin_cpu_supports("f16c"))    return SCM_SIMD_AVX2;
+
+    return SCM_SIMD_SSE2;
+#else
+    return SCM_SIMD_SCALAR;
+#endif
+}
+
+// The selected instruction set, determined upon first use. Detection always
+// gives the same answer, so a race to initialize it is harmless.
+
+static int simd = -1;
+
+int scm_simd_level(void)
+{
+    if (simd < 0)
+        simd = scm_simd_detect();
+
+    return simd;
+}
+
+// Select instruction set l, or the most capable supported if l exceeds it.
+// This allows the scalar reference and each SIMD variant to be compared.
+
+void scm_simd_select(int l)
+{
+    simd = max(SCM_SIMD_SCALAR, min(l, scm_simd_detect()));
+}
+
+//------------------------------------------------------------------------------
+
+// Encode or decode n samples using the selected instruction set. Convert the
+// remainder not filling a vector using the scalar reference. Return false if
+// no SIMD instruction set is selected.
+
+bool ftob_simd(void *p, const float *f, size_t n, int b, int g)
+{
+#ifdef SCM_X86
+    size_t i;
+
+    if (scm_simd_level() == SCM_SIMD_SCALAR)
+        return false;
+
+    if (b == 32)
+    {
+        memcpy(p, f, n * sizeof (float));
+        return true;
+    }
+
+    switch (scm_simd_level())
+    {
+        case SCM_SIMD_AVX512: i = ftob_avx512(p, f, n, b, g); break;
+        case SCM_SIMD_AVX2:   i = ftob_avx2  (p, f, n, b, g); break;
+        default:              i = ftob_sse2  (p, f, n, b, g); break;
+    }
+
+    if (i < n)
+        ftob_scalar((uint8_t *) p + i * (size_t) b / 8, f + i, n - i, b, g);
+
+    return true;
+#else
+    return false;
+#endif
+}
+
+bool btof_simd(const void *p, float *f, size_t n, int b, int g)
+{
+#ifdef SCM_X86
+    size_t i;
+
+    if (scm_simd_level() == SCM_SIMD_SCALAR)
+        return false;
+
+    if (b == 32)
+    {
+        memcpy(f, p, n * sizeof (float));
+        return true;
+    }
+
+    switch (scm_simd_level())
+    {
+        case SCM_SIMD_AVX512: i = btof_avx512(p, f, n, b, g); break;
+        case SCM_SIMD_AVX2:   i = btof_avx2  (p, f, n, b, g); break;
+        default:              i = btof_sse2  (p, f, n, b, g); break;
+    }
+
+    if (i < n)
+        btof_scalar((const uint8_t *) p + i * (size_t) b / 8, f + i, n - i, b, g);
+
+    return true;
+#else
+    return false;
+#endif
+}
+
+//------------------------------------------------------------------------------
+
+// Apply the horizontal difference predictor to a row of n pixels of c channels
+// of b bits each. Vector kernels handle the bulk of the row, and scalar code the
+// remainder. Return false if no kernel applies.
+
+bool enhdif_simd(void *p, int n, int c, int b)
+{
+#ifdef SCM_X86
+    const size_t s = (size_t) n * (size_t) c;
+
+    if (scm_simd_level() == SCM_SIMD_SCALAR || c < 1 || c > 4)
+        return false;
+
+    if      (b == 8)
+    {
+        int8_t  *q = (int8_t  *) p;
+        size_t   j = enhdif_sse2_8 ((uint8_t *) p, s,     c);
+
+        for (; j > (size_t) c; --j)
+            q[j - 1] -= q[j - 1 - c];
+    }
+    else if (b == 16)
+    {
+        int16_t *q = (int16_t *) p;
+        size_t   j = enhdif_sse2_16((uint8_t *) p, s * 2, c) / 2;
+
+        for (; j > (size_t) c; --j)
+            q[j - 1] -= q[j - 1 - c];
+    }
+    else return false;
+
+    return true;
+#else
+    return false;
+#endif
+}
+
+bool dehdif_simd(void *p, int n, int c, int b)
+{
+#ifdef SCM_X86
+    const size_t s = (size_t) n * (size_t) c;
+
+    if (scm_simd_level() == SCM_SIMD_SCALAR || c < 1 || c > 4)
+        return false;
+
+    if      (b == 8)
+    {
+        int8_t  *q = (int8_t  *) p;
+        size_t   i = dehdif_sse2_8 ((uint8_t *) p, s,     c);
+
+        for (i = max(i, (size_t) c); i < s; ++i)
+            q[i] += q[i - c];
+    }
+    else if (b == 16)
+    {
+        int16_t *q = (int16_t *) p;
+        size_t   i = dehdif_sse2_16((uint8_t *) p, s * 2, c) / 2;
+
+        for (i = max(i, (size_t) c); i < s; ++i)
+            q[i] += q[i - c];
+    }
+    else return false;
+
+    return true;
+#else
+    return false;
+#endif
+}
+
+//------------------------------------------------------------------------------
@@ -36,11 +36,15 @@ int main(int argc, char **argv)
     int         A    =   0;
     int         h    =   0;
     int         l    =   0;
+    int         C    = 256;
+    int         S    =   0;
+    int         W    =   0;
     double      E[4] = { 0.f, 0.f, 0.f , 0.f};
     double      L[3] = { 0.f, 0.f, 0.f };
     double      P[3] = { 0.f, 0.f, 0.f };
     float       N[2] = { 0.f, 0.f };
     float       R[2] = { 0.f, 1.f };
+    int         Z[3] = { 0, SCM_DEFAULT_LEVEL, 0 };
 
     int c;
     int r = 0;
@@ -49,12 +53,13 @@ int main(int argc, char **argv)
 
     opterr = 0;
 
-    while ((c = getopt(argc, argv, "Ab:d:E:g:hL:l:m:n:N:o:p:P:Tt:R:w:")) != -1)
+    while ((c = getopt(argc, argv, "Ab:C:d:E:g:hL:l:m:n:N:o:p:P:r:Tt:R:uw:z:")) != -1)
         switch (c)
         {
             case 'A': A = 1;                    break;
             case 'h': h = 1;                    break;
             case 'T':                           break;
+            case 'u': Z[2] = 1;                 break;
             case 'p': p = optarg;               break;
             case 'm': m = optarg;               break;
             case 'o': o = optarg;               break;
@@ -64,6 +69,9 @@ int main(int argc, char **argv)
             case 'b': sscanf(optarg, "%d", &b); break;
             case 'g': sscanf(optarg, "%d", &g); break;
             case 'l': sscanf(optarg, "%d", &l); break;
+            case 'C': sscanf(optarg, "%d", &C); break;
+            case 'r': sscanf(optarg, "%d", &S); break;
+            case 'w': sscanf(optarg, "%d", &W); break;
 
             case 'E':
                 sscanf(optarg, "%lf,%lf,%lf,%lf", E + 0, E + 1, E + 2, E + 3);
@@ -80,6 +88,10 @@ int main(int argc, char **argv)
             case 'R':
                 sscanf(optarg, "%f,%f",           R + 0, R + 1);
                 break;
+            case 'z':
+                if (!scm_parse_compression(optarg, Z + 0, Z + 1))
+                    return -1;
+                break;
 
             case '?': apperr("Bad option -%c", optopt);                   break;
         }
@@ -87,16 +99,28 @@ int main(int argc, char **argv)
     argc -= optind;
     argv += optind;
 
+    if (S < 0)
+    {
+        apperr("Rows per strip %d is not positive", S);
+        return -1;
+    }
+
     if (p == NULL || h)
         apperr("\nUsage: %s [options] input [...]\n"
                 "\t\t-p process . . Select process\n"
                 "\t\t-o output  . . Output file\n"
+                "\t\t-z z[:l] . . . Output compression: none, deflate, zstd,\n"
+                "\t\t               lz4, or auto, at level l or auto\n"
+                "\t\t-u . . . . . . Store uniform pages as one pixel, which\n"
+                "\t\t               LibTIFF can't read\n"
                 "\t\t-T . . . . . . Emit timing information\n\n"
                 "\t%s -p convert [options]\n"
                 "\t\t-n n . . . . . Page size\n"
                 "\t\t-d d . . . . . Tree depth\n"
                 "\t\t-b b . . . . . Channel depth override\n"
-                "\t\t-g g . . . . . Channel sign override\n"
+                "\t\t-g g . . . . . Channel sign override, 2 for half float\n"
+                "\t\t-r r . . . . . Rows per strip\n"
+                "\t\t-w w . . . . . Tile size, a multiple of 16\n"
                 "\t\t-E w,e,s,n . . Equirectangular range\n"
                 "\t\t-L c,d0,d1 . . Longitude blend range\n"
                 "\t\t-P c,d0,d1 . . Latitude blend range\n"
@@ -113,36 +137,41 @@ int main(int argc, char **argv)
                 "\t\t-m sum . . . . Combine by sum\n"
                 "\t\t-m max . . . . Combine by maximum\n"
                 "\t\t-m avg . . . . Combine by average\n\n"
-                "\t%s -p border\n\n"
+                "\t%s -p border [-C c]\n"
+                "\t\t-C c . . . . . Page cache size in MB\n\n"
                 "\t%s -p prune\n\n"
                 "\t%s -p finish [options]\n"
                 "\t\t-t text  . . . Image description text file\n"
                 "\t\t-l l . . . . . Bounding volume oversample level\n\n"
                 "\t%s -p extrema\n\n"
-                "\t%s -p query\n",
+                "\t%s -p query\n\n"
+                "\t%s -p bench [-r r] [-m kernel]\n"
+                "\t\t-r r . . . . . Rows per strip, or all if omitted\n"
+                "\t\t-m kernel  . . Benchmark sample conversion kernels\n",
 
-                exe, exe, exe, exe, exe, exe, exe, exe, exe, exe);
+                exe, exe, exe, exe, exe, exe, exe, exe, exe, exe, exe);
 
     else if (strcmp(p, "convert") == 0)
-        r = convert(argc, argv, o, n, d, b, g, A, N, E, L, P);
+        r = convert(argc, argv, o, n, d, b, g, S ? S : SCM_DEFAULT_ROWS,
+                                                        W, A, Z, N, E, L, P);
 
     else if (strcmp(p, "rectify") == 0)
         r = rectify(argc, argv, o, n,             N, E, L, P);
 
     else if (strcmp(p, "combine") == 0)
-        r = combine(argc, argv, o, m);
+        r = combine(argc, argv, o, m, Z);
 
     else if (strcmp(p, "normal") == 0)
-        r = normal (argc, argv, o, R);
+        r = normal (argc, argv, o, R, Z);
 
     else if (strcmp(p, "mipmap") == 0)
-        r = mipmap (argc, argv, o, m, A);
+        r = mipmap (argc, argv, o, m, A, Z);
 
     else if (strcmp(p, "border") == 0)
-        r = border (argc, argv, o);
+        r = border (argc, argv, o, C, Z);
 
     else if (strcmp(p, "prune")  == 0)
-        r = prune  (argc, argv, o);
+        r = prune  (argc, argv, o, Z);
 
     else if (strcmp(p, "finish") == 0)
         r = finish (argc, argv, t, l);
@@ -156,6 +185,9 @@ int main(int argc, char **argv)
     else if (strcmp(p, "query")   == 0)
         r = query  (argc, argv);
 
+    else if (strcmp(p, "bench")   == 0)
+        r = bench  (argc, argv, o, m, S, Z);
+
     else if (strcmp(p, "sample") == 0)
         r = sample (argc, argv, R, d);
 